@@ -0,0 +1,320 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		BenchDispatch.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Benchmark measuring the cost of dispatching an event
+ *				to key binds, mouse binds and hooks as their number
+ *				grows, and the cost of injecting an event. Prints
+ *				the results as JSON.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// --------------------------------------------------
+
+// Prebuilt records are passed straight to the dispatcher, so the bind and hook cases
+// measure dispatching alone. The injection path is measured by its own cases.
+#define BENCH_POINTS		4096			// Distinct events cycled through
+#define BENCH_BUDGET		20000000		// Events times handlers per case, bounds the run time
+#define BENCH_MIN_EVENTS	2000
+#define BENCH_MAX_EVENTS	200000
+#define BENCH_MAX_COUNT		100000
+
+#define BENCH_SCREEN_W		1920
+#define BENCH_SCREEN_H		1080
+#define BENCH_CLUSTERS		8				// Number of clusters in the clustered layout
+#define BENCH_CLUSTER_SIZE	256				// Width and height of a cluster
+
+#define BENCH_KEY_BASE		0x10000			// Keys beyond the direct key table, like X11 keysyms
+
+typedef enum {
+	LAYOUT_NONE,
+	LAYOUT_UNIFORM,			// Rectangles spread evenly over the screen
+	LAYOUT_CLUSTERED,		// Rectangles packed into a few small areas (toolbars, dialogs)
+} BENCH_LAYOUT;
+
+static const char* layout_names[] = { "none", "uniform", "clustered" };
+
+static uint32 bench_calls = 0;				// Handler invocations during the current case
+static bool bench_first = true;				// Is the next result the first one printed
+
+// --------------------------------------------------
+
+static double bench_time( void )
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &now );
+
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static bool bench_key_handler( uint32 key, void* data )
+{
+	UNREFERENCED_PARAM( key );
+	UNREFERENCED_PARAM( data );
+
+	bench_calls++;
+	return true;
+}
+
+static bool bench_mouse_handler( MOUSEBTN button, uint16 x, uint16 y, void* data )
+{
+	UNREFERENCED_PARAM( button );
+	UNREFERENCED_PARAM( x );
+	UNREFERENCED_PARAM( y );
+	UNREFERENCED_PARAM( data );
+
+	bench_calls++;
+	return true;
+}
+
+static bool bench_hook( InputEvent* event )
+{
+	UNREFERENCED_PARAM( event );
+
+	bench_calls++;
+	return true;
+}
+
+static void bench_key_record( InputEventRecord* record, uint32 key )
+{
+	memset( record, 0, sizeof(*record) );
+
+	record->event.type = INPUT_KEY_DOWN;
+	record->event.keyboard.key = key;
+}
+
+static void bench_motion_record( InputEventRecord* record, int16 x, int16 y )
+{
+	memset( record, 0, sizeof(*record) );
+
+	record->event.type = INPUT_MOUSE_MOVE;
+	record->event.mouse.x = x;
+	record->event.mouse.y = y;
+}
+
+static uint32 bench_event_count( uint32 count )
+{
+	uint32 events;
+
+	events = BENCH_BUDGET / count;
+
+	if ( events < BENCH_MIN_EVENTS ) events = BENCH_MIN_EVENTS;
+	if ( events > BENCH_MAX_EVENTS ) events = BENCH_MAX_EVENTS;
+
+	return events;
+}
+
+static void bench_random_point( BENCH_LAYOUT layout, const int16* clusters, int16* x, int16* y )
+{
+	uint32 i;
+
+	if ( layout == LAYOUT_CLUSTERED )
+	{
+		i = (uint32)rand() % BENCH_CLUSTERS;
+
+		*x = (int16)( clusters[i*2] + rand() % BENCH_CLUSTER_SIZE );
+		*y = (int16)( clusters[i*2+1] + rand() % BENCH_CLUSTER_SIZE );
+	}
+	else
+	{
+		*x = (int16)( rand() % BENCH_SCREEN_W );
+		*y = (int16)( rand() % BENCH_SCREEN_H );
+	}
+}
+
+static void bench_print( const char* name, BENCH_LAYOUT layout, uint32 count, uint32 events, double seconds )
+{
+	printf( "%s\n\t\t{ \"case\": \"%s\", \"layout\": \"%s\", \"count\": %u, \"events\": %u, "
+			"\"ns_per_event\": %.2f, \"calls_per_event\": %.2f }",
+			bench_first ? "" : ",", name, layout_names[layout], count, events,
+			seconds * 1e9 / events, (double)bench_calls / events );
+
+	bench_first = false;
+	fflush( stdout );
+}
+
+static void bench_key_down_binds( uint32 count )
+{
+	static InputEventRecord records[BENCH_POINTS];
+	uint32 i, events;
+	double start;
+	int window;
+
+	input_initialize( &window );
+
+	for ( i = 0; i < count; i++ )
+		input_add_key_down_bind( BENCH_KEY_BASE + i, bench_key_handler, NULL );
+
+	for ( i = 0; i < BENCH_POINTS; i++ )
+		bench_key_record( &records[i], BENCH_KEY_BASE + (uint32)rand() % count );
+
+	events = bench_event_count( 1 );
+	bench_calls = 0;
+
+	start = bench_time();
+
+	for ( i = 0; i < events; i++ )
+		input_dispatch_record( &records[i % BENCH_POINTS] );
+
+	bench_print( "key_down_bind", LAYOUT_NONE, count, events, bench_time() - start );
+
+	input_shutdown();
+}
+
+static void bench_mouse_move_binds( uint32 count, BENCH_LAYOUT layout )
+{
+	static InputEventRecord records[BENCH_POINTS];
+	int16 clusters[BENCH_CLUSTERS*2];
+	rectangle_t r;
+	int16 x, y;
+	uint32 i, events;
+	double start;
+	int window;
+
+	input_initialize( &window );
+
+	for ( i = 0; i < BENCH_CLUSTERS; i++ )
+	{
+		clusters[i*2] = (int16)( rand() % ( BENCH_SCREEN_W - BENCH_CLUSTER_SIZE ) );
+		clusters[i*2+1] = (int16)( rand() % ( BENCH_SCREEN_H - BENCH_CLUSTER_SIZE ) );
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		bench_random_point( layout, clusters, &r.x, &r.y );
+		r.w = (int16)( 16 + rand() % 64 );
+		r.h = (int16)( 16 + rand() % 64 );
+
+		input_add_mouse_move_bind( &r, bench_mouse_handler, NULL );
+	}
+
+	for ( i = 0; i < BENCH_POINTS; i++ )
+	{
+		bench_random_point( layout, clusters, &x, &y );
+		bench_motion_record( &records[i], x, y );
+	}
+
+	events = bench_event_count( count );
+	bench_calls = 0;
+
+	start = bench_time();
+
+	for ( i = 0; i < events; i++ )
+		input_dispatch_record( &records[i % BENCH_POINTS] );
+
+	bench_print( "mouse_move_bind", layout, count, events, bench_time() - start );
+
+	input_shutdown();
+}
+
+static void bench_hooks( uint32 count )
+{
+	static InputEventRecord records[BENCH_POINTS];
+	uint32 i, events;
+	double start;
+	int window;
+
+	input_initialize( &window );
+
+	for ( i = 0; i < count; i++ )
+		input_add_hook( INPUT_MOUSE_MOVE, bench_hook );
+
+	for ( i = 0; i < BENCH_POINTS; i++ )
+		bench_motion_record( &records[i], (int16)( i & 1023 ), (int16)( ( i >> 10 ) & 511 ) );
+
+	events = bench_event_count( count );
+	bench_calls = 0;
+
+	start = bench_time();
+
+	for ( i = 0; i < events; i++ )
+		input_dispatch_record( &records[i % BENCH_POINTS] );
+
+	bench_print( "hook", LAYOUT_NONE, count, events, bench_time() - start );
+
+	input_shutdown();
+}
+
+static void bench_injection( void )
+{
+	uint32 i, events;
+	double start;
+	int window;
+
+	// A single bind and hook, so the results are mostly the cost of the injection path
+	input_initialize( &window );
+
+	input_add_key_down_bind( BENCH_KEY_BASE, bench_key_handler, NULL );
+	input_add_hook( INPUT_MOUSE_MOVE, bench_hook );
+
+	events = BENCH_MAX_EVENTS;
+	bench_calls = 0;
+
+	start = bench_time();
+
+	for ( i = 0; i < events; i++ )
+		input_inject_key( BENCH_KEY_BASE, true );
+
+	bench_print( "inject_key", LAYOUT_NONE, 1, events, bench_time() - start );
+
+	bench_calls = 0;
+
+	start = bench_time();
+
+	for ( i = 0; i < events; i++ )
+		input_inject_motion( (int16)( i & 1023 ), (int16)( ( i >> 10 ) & 511 ) );
+
+	bench_print( "inject_motion", LAYOUT_NONE, 1, events, bench_time() - start );
+
+	input_shutdown();
+}
+
+int main( int argc, char** argv )
+{
+	static const uint32 counts[] = { 1, 10, 100, 1000, 10000, 100000 };
+	uint32 i, max_count = BENCH_MAX_COUNT;
+
+	// The largest bind and hook count can be limited for quick runs
+	if ( argc > 1 ) max_count = (uint32)strtoul( argv[1], NULL, 10 );
+
+	srand( 1 );
+
+	printf( "{\n\t\"benchmark\": \"dispatch\",\n\t\"results\": [" );
+
+	bench_injection();
+
+	for ( i = 0; i < sizeof(counts) / sizeof(counts[0]) && counts[i] <= max_count; i++ )
+	{
+		bench_key_down_binds( counts[i] );
+		bench_mouse_move_binds( counts[i], LAYOUT_UNIFORM );
+		bench_mouse_move_binds( counts[i], LAYOUT_CLUSTERED );
+		bench_hooks( counts[i] );
+	}
+
+	printf( "\n\t]\n}\n" );
+
+	return 0;
+}
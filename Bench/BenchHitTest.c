@@ -0,0 +1,204 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		BenchHitTest.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Micro-benchmark comparing the linked list mouse bind
+ *				hit test against the structure of arrays hit test.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// --------------------------------------------------
+
+#define BENCH_POINTS		4096		// Random cursor positions tested per round
+#define BENCH_ROUNDS		64
+
+// Mirrors the layout of the old list based MouseBind
+typedef struct BenchNode {
+	struct BenchNode*	next;
+	struct BenchNode*	prev;
+	uint32				type;
+	rectangle_t			bounds;
+	uint32				button;
+	void*				handler;
+	void*				userdata;
+} BenchNode;
+
+static volatile uint32 bench_sink = 0;	// Keeps the compiler from optimizing the tests away
+
+// --------------------------------------------------
+
+static double bench_time( void )
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &now );
+
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void bench_random_rect( rectangle_t* r )
+{
+	r->x = (int16)( rand() % 1920 );
+	r->y = (int16)( rand() % 1080 );
+	r->w = (int16)( 16 + rand() % 240 );
+	r->h = (int16)( 16 + rand() % 80 );
+}
+
+static double bench_list( BenchNode* first, const int16* px, const int16* py )
+{
+	BenchNode* node;
+	uint32 round, i, hits = 0;
+	double start;
+
+	start = bench_time();
+
+	for ( round = 0; round < BENCH_ROUNDS; round++ )
+	{
+		for ( i = 0; i < BENCH_POINTS; i++ )
+		{
+			for ( node = first; node; node = node->next )
+			{
+				if ( rect_is_point_in( &node->bounds, px[i], py[i] ) ) hits++;
+			}
+		}
+	}
+
+	bench_sink += hits;
+
+	return ( bench_time() - start ) * 1e9 / ( BENCH_ROUNDS * BENCH_POINTS );
+}
+
+static double bench_soa( input_hit_test_t test, const InputBounds* bounds, uint32 count, const int16* px, const int16* py )
+{
+	uint32 round, i, j, mask, hits = 0;
+	double start;
+
+	start = bench_time();
+
+	for ( round = 0; round < BENCH_ROUNDS; round++ )
+	{
+		for ( i = 0; i < BENCH_POINTS; i++ )
+		{
+			for ( j = 0; j < count; j += INPUT_HIT_BATCH )
+			{
+				for ( mask = test( bounds, j, px[i], py[i] ); mask; mask &= mask - 1 ) hits++;
+			}
+		}
+	}
+
+	bench_sink += hits;
+
+	return ( bench_time() - start ) * 1e9 / ( BENCH_ROUNDS * BENCH_POINTS );
+}
+
+static void bench_run( uint32 count )
+{
+	BenchNode** nodes;
+	BenchNode* first = NULL;
+	InputBounds bounds;
+	int16* block;
+	int16 px[BENCH_POINTS], py[BENCH_POINTS];
+	uint32 padded, i, j;
+	double list_ns, scalar_ns, simd_ns;
+
+	padded = ( count + INPUT_HIT_BATCH - 1 ) & ~( INPUT_HIT_BATCH - 1 );
+
+	nodes = malloc( count * sizeof(*nodes) );
+	block = malloc( 4 * padded * sizeof(int16) );
+
+	bounds.x0 = block;
+	bounds.y0 = block + padded;
+	bounds.x1 = block + padded * 2;
+	bounds.y1 = block + padded * 3;
+
+	for ( i = 0; i < padded; i++ )
+	{
+		bounds.x0[i] = bounds.y0[i] = 32767;
+		bounds.x1[i] = bounds.y1[i] = -32768;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		nodes[i] = calloc( 1, sizeof(BenchNode) );
+		bench_random_rect( &nodes[i]->bounds );
+
+		bounds.x0[i] = nodes[i]->bounds.x;
+		bounds.y0[i] = nodes[i]->bounds.y;
+		bounds.x1[i] = nodes[i]->bounds.x + nodes[i]->bounds.w;
+		bounds.y1[i] = nodes[i]->bounds.y + nodes[i]->bounds.h;
+	}
+
+	// Link the nodes in a shuffled order to resemble a list built over a long session
+	for ( i = count; i > 1; i-- )
+	{
+		BenchNode* tmp;
+
+		j = (uint32)rand() % i;
+		tmp = nodes[i-1]; nodes[i-1] = nodes[j]; nodes[j] = tmp;
+	}
+
+	for ( i = count; i--; )
+	{
+		nodes[i]->next = first;
+		first = nodes[i];
+	}
+
+	for ( i = 0; i < BENCH_POINTS; i++ )
+	{
+		px[i] = (int16)( rand() % 1920 );
+		py[i] = (int16)( rand() % 1080 );
+	}
+
+	list_ns = bench_list( first, px, py );
+	scalar_ns = bench_soa( input_hit_test_scalar, &bounds, count, px, py );
+	simd_ns = bench_soa( input_hit_test, &bounds, count, px, py );
+
+	printf( "%8u %12.1f %12.1f %12.1f %8.2fx\n", count, list_ns, scalar_ns, simd_ns, list_ns / simd_ns );
+
+	for ( i = 0; i < count; i++ )
+		free( nodes[i] );
+
+	free( nodes );
+	free( block );
+}
+
+int main( int argc, char** argv )
+{
+	static const uint32 counts[] = { 50, 200, 500, 1000, 2000, 5000 };
+	uint32 i;
+
+	UNREFERENCED_PARAM( argc );
+	UNREFERENCED_PARAM( argv );
+
+	srand( 1 );
+	input_hit_test_initialize();
+
+	printf( "%8s %12s %12s %12s %9s\n", "binds", "list ns", "scalar ns", "simd ns", "speedup" );
+
+	for ( i = 0; i < sizeof(counts) / sizeof(counts[0]); i++ )
+		bench_run( counts[i] );
+
+	return 0;
+}
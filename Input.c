@@ -11,32 +11,40 @@
 
 #include "Input.h"
 #include "InputSys.h"
+#include "InputAtomic.h"
 #include "Types/List.h"
 #include "Platform/Alloc.h"
 #include "Platform/Window.h"
 #include <assert.h>
+#include <string.h>
 
 // --------------------------------------------------
 
-static bool		input_initialized				= false;	// Is the library properly initialized?
-static bool		block_keys						= false;	// Should keyboard input be blocked
-bool			show_cursor						= true;		// Display mouse cursor
-int16			mouse_x							= 0;		// Current mouse x coordinate
-int16			mouse_y							= 0;		// Current mouse y coordinate
-static list_t*	input_hooks[NUM_INPUT_EVENTS]	= { NULL };	// A list of custom input hooks
-static list_t*	char_binds						= NULL;		// Character input binds
-static list_t*	key_up_binds					= NULL;		// Key up hooks
-static list_t*	key_down_binds					= NULL;		// Key down hooks
-static list_t*	mouse_up_binds					= NULL;		// Mouse button up binds
-static list_t*	mouse_down_binds				= NULL;		// Mouse button down binds
-static list_t*	mouse_move_binds				= NULL;		// Mouse move binds
+// Bind handles are pool handles tagged with the type of the bind
+#define BIND_HANDLE_KEY			( 1u << 30 )
+#define BIND_HANDLE_MOUSE		( 2u << 30 )
+#define BIND_HANDLE_TYPE_MASK	( 3u << 30 )
 
 // --------------------------------------------------
 
+#ifdef INPUT_PROFILE
+// Call statistics of a single hook or bind handler
+typedef struct {
+	uint32			calls;
+	uint32			consumed;		// Calls which returned false
+	uint64			total_time;		// Time spent in the handler in nanoseconds
+	uint64			max_time;
+} HandlerProfile;
+#endif
+
 // Input hook functions
 typedef struct {
 	node_t node;
 	input_handler_t handler;
+#ifdef INPUT_PROFILE
+	INPUT_EVENT event;
+	HandlerProfile profile;
+#endif
 } InputHookFunc;
 
 // Keyboard bind types
@@ -44,6 +52,8 @@ typedef enum {
 	BIND_KEYUP,
 	BIND_KEYDOWN,
 	BIND_CHAR,
+	BIND_CHORD,
+	BIND_SEQUENCE,
 } BINDTYPE_KB;
 
 // Mouse bind types
@@ -53,6 +63,13 @@ typedef enum {
 	BIND_MOVE
 } BINDTYPE_MOUSE;
 
+// Key strokes of a sequence bind
+typedef struct {
+	uint32			length;
+	uint32			timeout;		// Maximum time between two keys in milliseconds
+	InputKeyStroke	keys[INPUT_MAX_SEQUENCE_LENGTH];
+} KeySequence;
+
 // Keybind structure
 struct KeyBind {
 	node_t			node;
@@ -60,8 +77,37 @@ struct KeyBind {
 	uint32			key;
 	keybind_func_t	handler;
 	void*			userdata;
+	uint32			modifiers;		// Generic modifiers of a chord bind (INPUT_MOD_SHIFT etc.)
+	uint32			serial;			// Registration order, keeps the key slots sorted
+	uint8			layer;			// Layer the bind belongs to
+	bool			disabled;		// Disabled binds stay registered but are not called
+	KeySequence*	sequence;		// Keys of a sequence bind, NULL for other binds
+#ifdef INPUT_PROFILE
+	HandlerProfile	profile;
+#endif
 };
 
+// Binds registered for a single key and modifier combination, in registration order
+typedef struct {
+	uint32			key;
+	uint32			modifiers;		// Only used by chord binds, zero for plain key binds
+	uint32			count;
+	uint32			capacity;
+	KeyBind**		binds;
+} KeyBindSlot;
+
+// Per-key bind index. Keys within the ASCII/virtual key range are mapped directly,
+// larger keys (X11 keysyms) and chords with modifiers go through an open-addressed hash.
+#define KEYTABLE_DIRECT_SIZE	256
+#define KEYTABLE_INITIAL_SIZE	64
+
+typedef struct {
+	KeyBindSlot		direct[KEYTABLE_DIRECT_SIZE];
+	KeyBindSlot*	hashed;
+	uint32			hashed_size;	// Always a power of two
+	uint32			hashed_used;	// Number of occupied hash slots
+} KeyBindTable;
+
 // Mousebind structure
 struct MouseBind {
 	node_t				node;
@@ -70,534 +116,2802 @@ struct MouseBind {
 	MOUSEBTN			button;
 	mousebind_func_t	handler;
 	void*				userdata;
+	uint8				layer;			// Layer the bind belongs to
+	bool				disabled;		// Disabled binds stay registered but are not called
+	uint32				serial;			// Registration order, used to keep the grid cells sorted
+	int16				cell_x0;		// Grid cells covered by the bind, cell_x0 is -1 when
+	int16				cell_y0;		// the bind is stored in the overflow cell instead
+	int16				cell_x1;
+	int16				cell_y1;
+#ifdef INPUT_PROFILE
+	HandlerProfile		profile;
+#endif
 };
 
-// --------------------------------------------------
-
-void input_initialize( void* window )
-{
-	uint32 i;
+// Mouse binds overlapping a grid cell, sorted by registration order. The bounds
+// of the binds are also stored as a structure of arrays for vectorized hit tests.
+typedef struct {
+	uint32			count;
+	uint32			capacity;		// Always a multiple of INPUT_HIT_BATCH
+	MouseBind**		binds;
+	InputBounds		bounds;
+} MouseBindCell;
+
+// Uniform grid over mouse bind bounds. Binds which fall outside the grid or would
+// cover too many cells are kept in a separate overflow cell which is always tested.
+#define MOUSEGRID_CELL_SHIFT	6		// 64x64 pixel cells
+#define MOUSEGRID_SIZE			64		// Cells per axis, the grid covers 4096x4096 pixels
+#define MOUSEGRID_MAX_CELLS		64		// Binds covering more cells go to the overflow cell
+#define MOUSEGRID_STACK_HITS	64		// Hits collected on stack before falling back to heap
 
-	if ( !window ) return;
+typedef struct {
+	list_t*			binds;			// All binds of this type
+	MouseBindCell*	cells;			// MOUSEGRID_SIZE * MOUSEGRID_SIZE cells
+	MouseBindCell	overflow;		// Binds not stored in the grid
+} MouseBindIndex;
 
-	// Initialize hook lists
-	for ( i = NUM_INPUT_EVENTS; i--; )
-		input_hooks[i] = list_create();
+// A named set of binds. Layers are activated by pushing them onto the layer stack,
+// dispatch goes through the active layers from the top of the stack down.
+typedef struct {
+	char			name[INPUT_LAYER_NAME_LEN];
+	uint32			flags;				// INPUT_LAYER_* flags
+	bool			created;
+	bool			enabled;			// Disabled layers are skipped even when on the stack
+	bool			stacked;			// Is the layer on the layer stack
+	list_t*			char_binds;			// Character input binds
+	KeyBindTable	key_up_binds;		// Key up binds
+	KeyBindTable	key_down_binds;		// Key down binds
+	KeyBindTable	chord_binds;		// Key down binds with modifiers, keyed on both
+	list_t*			sequence_binds;		// Key sequence binds
+	MouseBindIndex	mouse_up_binds;		// Mouse button up binds
+	MouseBindIndex	mouse_down_binds;	// Mouse button down binds
+	MouseBindIndex	mouse_move_binds;	// Mouse move binds
+} InputLayer;
+
+// Registrations made on other threads are posted as ops and applied by the input
+// thread before it dispatches the next event, or when it adds or removes a bind itself.
+// Only the input thread reads or modifies the bind tables, so dispatch needs no locks.
+// Registrations made by handlers during dispatch are deferred the same way until the
+// outermost dispatch returns, so the tables never change while they are being walked.
+typedef enum {
+	OP_LINK_HOOK,				// Add an allocated hook to its list
+	OP_REMOVE_HOOK,
+	OP_LINK_KEY_BIND,			// Add an allocated bind to the current bind layer
+	OP_LINK_MOUSE_BIND,
+	OP_REMOVE_KEY_BINDS,		// Remove binds by key and handler
+	OP_REMOVE_SEQUENCE_BINDS,
+	OP_REMOVE_MOUSE_BINDS,
+	OP_REMOVE_BIND,				// Remove a bind by its handle
+	OP_ENABLE_BIND,				// Change a bind by its handle
+	OP_SET_BIND_PARAM,
+	OP_SET_BIND_RECT,
+	OP_SET_BIND_BUTTON,
+	OP_SET_BIND_FUNC,
+} INPUT_OP;
+
+typedef struct InputOp {
+	struct InputOp*		next;
+	INPUT_OP			type;
+	union {
+		struct {
+			InputHookFunc*		hook;
+			INPUT_EVENT			event;
+			input_handler_t		handler;
+		} hook;
+		struct {
+			uint32				key;
+			uint32				modifiers;
+			keybind_func_t		func;
+			BINDTYPE_KB			type;
+		} keys;
+		struct {
+			InputKeyStroke		keys[INPUT_MAX_SEQUENCE_LENGTH];
+			uint32				count;
+			keybind_func_t		func;
+		} sequence;
+		struct {
+			MOUSEBTN			button;
+			mousebind_func_t	func;
+			BINDTYPE_MOUSE		type;
+		} mouse;
+		struct {
+			input_bind_t		handle;
+			union {
+				bool				enable;
+				void*				data;
+				rectangle_t			rect;
+				MOUSEBTN			button;
+				mousebind_func_t	func;
+			};
+		} change;
+		KeyBind*			key_bind;
+		MouseBind*			mouse_bind;
+		input_bind_t		handle;
+	};
+} InputOp;
+
+// All state of an input context except the parts kept by the other modules (see
+// InputContextState). The default context lives as long as the process and is current
+// on every thread until another context is set, so the library can be used without
+// creating any contexts.
+struct InputContext {
+	InputContextState	shared;						// State used by the other modules
+	bool				initialized;				// Is the context properly initialized?
+	bool				block_keys;					// Should keyboard input be blocked
+	list_t*				input_hooks[NUM_INPUT_EVENTS];	// A list of custom input hooks
+	uint32				bind_serial;				// Registration counter for binds
+	InputLayer			layers[INPUT_MAX_LAYERS];	// All created layers, the default layer is always the first
+	uint8				layer_stack[INPUT_MAX_LAYERS];	// Active layer stack, the default layer is always at the bottom
+	uint32				layer_stack_size;
+	uint32				bind_layer;					// Layer new binds are added to
+	uint32				modifier_state;				// Currently held modifiers and active locks (INPUT_MOD_*)
+	uint64				capture_time;				// Time of the event being captured in nanoseconds
+	uint64				event_time;					// Time of the event being dispatched
+	uint32				event_modifiers;			// Modifier state of the event being dispatched
+	bool				event_modifier_key;			// Is the key of the event being dispatched a modifier
+	bool				key_consumed;				// Was the previously dispatched event a consumed key press
+	bool				coalesce_motion;			// Merge motion events until the end of the frame
+	bool				motion_pending;				// Is there coalesced motion waiting to be dispatched
+	InputEventRecord	motion;						// Coalesced motion event
+	bool				relative_mouse;				// Is the mouse in relative mode
+	bool				modifier_key_down;			// Was the last key pressed a modifier key
+	InputSequenceAutomaton sequence_fsm;			// Matches the sequence binds of all layers
+	bool				sequences_dirty;			// Sequence binds have changed since the automaton was built
+	InputPool			keybind_pool;				// Storage for KeyBind structs
+	InputPool			mousebind_pool;				// Storage for MouseBind structs
+	InputPool			hook_pool;					// Storage for InputHookFunc structs
+	InputOp* volatile	pending_ops;				// Registrations posted by other threads, newest first
+	InputOp*			deferred_ops;				// Registrations made during dispatch, oldest first
+	InputOp*			deferred_tail;
+	uint32				dispatch_depth;				// Number of nested event dispatches
+	void* volatile		input_thread;				// Token of the thread dispatching the events
+};
 
-	// Initialize key/mouse binds
-	char_binds = list_create();
-	key_up_binds = list_create();
-	key_down_binds = list_create();
-	mouse_up_binds = list_create();
-	mouse_down_binds = list_create();
-	mouse_move_binds = list_create();
+static input_context_t default_context;
+static INPUT_THREAD_LOCAL input_context_t* context = &default_context;	// Current context of the thread
+static INPUT_THREAD_LOCAL uint8 thread_token;							// Its address identifies the thread
 
-	// Do window system specific initializing (event hooks etc)
-	input_platform_initialize( window );
+// --------------------------------------------------
 
-	input_initialized = true;
+static INPUT_EVENT input_key_bind_event( const KeyBind* bind )
+{
+	switch ( bind->type )
+	{
+	case BIND_CHAR: return INPUT_CHARACTER;
+	case BIND_KEYUP: return INPUT_KEY_UP;
+	default: return INPUT_KEY_DOWN;
+	}
 }
 
-static void input_cleanup_list( list_t* list )
+static INPUT_EVENT input_mouse_bind_event( const MouseBind* bind )
 {
-	node_t *node, *tmp;
+	if ( bind->type == BIND_MOVE ) return INPUT_MOUSE_MOVE;
 
-	list_foreach_safe( list, node, tmp )
+	switch ( bind->button )
 	{
-		list_remove( list, node );
-		mem_free( node );
+	case MOUSE_MBUTTON: return bind->type == BIND_BTNUP ? INPUT_MBUTTON_UP : INPUT_MBUTTON_DOWN;
+	case MOUSE_RBUTTON: return bind->type == BIND_BTNUP ? INPUT_RBUTTON_UP : INPUT_RBUTTON_DOWN;
+	default: return bind->type == BIND_BTNUP ? INPUT_LBUTTON_UP : INPUT_LBUTTON_DOWN;
 	}
+}
+#ifdef INPUT_PROFILE
+static void input_profile_add( InputPool* pool, void* object, uint32 handle, HandlerProfile* profile, uint64 time, bool ret )
+{
+	// The handler may have removed its own hook or bind
+	if ( input_pool_lookup( pool, handle ) != object ) return;
 
-	list_destroy( list );
+	profile->calls++;
+	profile->total_time += time;
+
+	if ( time > profile->max_time ) profile->max_time = time;
+	if ( !ret ) profile->consumed++;
 }
+#endif
 
-void input_shutdown( void )
+// Handlers are called through these so they can be timed when profiling or
+// recording the timeline. The hook or bind may be gone once the handler returns.
+static bool input_call_key_handler( KeyBind* bind, uint32 key )
 {
-	uint32 i;
+	keybind_func_t handler;
+	INPUT_EVENT event;
+	uint64 start, end;
+	bool ret;
+#ifdef INPUT_PROFILE
+	uint32 handle;
+
+	handle = input_pool_handle( bind );
+#else
+	if ( !input_timeline_is_enabled() ) return bind->handler( key, bind->userdata );
+#endif
+
+	handler = bind->handler;
+	event = input_key_bind_event( bind );
+	start = input_platform_get_time();
+
+	ret = handler( key, bind->userdata );
+	end = input_platform_get_time();
+
+#ifdef INPUT_PROFILE
+	input_profile_add( &context->keybind_pool, bind, handle, &bind->profile, end - start, ret );
+#endif
+	if ( input_timeline_is_enabled() ) input_timeline_handler( INPUT_HANDLER_KEYBIND, (void*)handler, event, start, end, !ret );
 
-	if ( !input_initialized ) return;
+	return ret;
+}
 
-	// Destroy input hook lists
-	for ( i = NUM_INPUT_EVENTS; i--; )
-	{
-		if ( input_hooks[i] != NULL )
-		{
-			input_cleanup_list( input_hooks[i] );
-			input_hooks[i] = NULL;
-		}
-	}
+static bool input_call_mouse_handler( MouseBind* bind, MOUSEBTN button, int16 x, int16 y )
+{
+	mousebind_func_t handler;
+	INPUT_EVENT event;
+	uint64 start, end;
+	bool ret;
+#ifdef INPUT_PROFILE
+	uint32 handle;
+
+	handle = input_pool_handle( bind );
+#else
+	if ( !input_timeline_is_enabled() ) return bind->handler( button, x, y, bind->userdata );
+#endif
+
+	handler = bind->handler;
+	event = input_mouse_bind_event( bind );
+	start = input_platform_get_time();
+
+	ret = handler( button, x, y, bind->userdata );
+	end = input_platform_get_time();
+
+#ifdef INPUT_PROFILE
+	input_profile_add( &context->mousebind_pool, bind, handle, &bind->profile, end - start, ret );
+#endif
+	if ( input_timeline_is_enabled() ) input_timeline_handler( INPUT_HANDLER_MOUSEBIND, (void*)handler, event, start, end, !ret );
 
-	// Destroy key/mouse binds
-	input_cleanup_list( char_binds );
-	input_cleanup_list( key_up_binds );
-	input_cleanup_list( key_down_binds );
-	input_cleanup_list( mouse_up_binds );
-	input_cleanup_list( mouse_down_binds );
-	input_cleanup_list( mouse_move_binds );
-
-	char_binds = NULL;
-	key_up_binds = NULL;
-	key_down_binds = NULL;
-	mouse_up_binds = NULL;
-	mouse_down_binds = NULL;
-	mouse_move_binds = NULL;
+	return ret;
+}
 
-	// Do window system specific cleanup
-	input_platform_shutdown();
+static bool input_call_hook( InputHookFunc* hook, InputEvent* event )
+{
+	input_handler_t handler;
+	INPUT_EVENT type;
+	uint64 start, end;
+	bool ret;
+#ifdef INPUT_PROFILE
+	uint32 handle;
+
+	handle = input_pool_handle( hook );
+#else
+	if ( !input_timeline_is_enabled() ) return hook->handler( event );
+#endif
 
-	input_initialized = false;
+	handler = hook->handler;
+	type = event->type;
+	start = input_platform_get_time();
+
+	ret = handler( event );
+	end = input_platform_get_time();
+
+#ifdef INPUT_PROFILE
+	input_profile_add( &context->hook_pool, hook, handle, &hook->profile, end - start, ret );
+#endif
+	if ( input_timeline_is_enabled() ) input_timeline_handler( INPUT_HANDLER_HOOK, (void*)handler, type, start, end, !ret );
+
+	return ret;
 }
 
-void input_add_hook( INPUT_EVENT event_id, input_handler_t handler )
+// --------------------------------------------------
+
+static uint32 input_chord_modifiers( uint32 modifiers )
 {
-	InputHookFunc* hook;
+	uint32 chord = 0;
 
-	if ( !input_initialized ) return;
-	if ( event_id >= NUM_INPUT_EVENTS ) return;
+	// Chords match either side of a modifier and ignore lock keys
+	if ( modifiers & INPUT_MOD_SHIFT ) chord |= INPUT_MOD_SHIFT;
+	if ( modifiers & INPUT_MOD_CONTROL ) chord |= INPUT_MOD_CONTROL;
+	if ( modifiers & INPUT_MOD_ALT ) chord |= INPUT_MOD_ALT;
+	if ( modifiers & INPUT_MOD_SUPER ) chord |= INPUT_MOD_SUPER;
 
-	hook = mem_alloc_clean( sizeof(*hook) );
-	hook->handler = handler;
+	return chord;
+}
 
-	list_push( input_hooks[event_id], &hook->node );
+static uint32 input_keytable_hash( uint32 key, uint32 modifiers )
+{
+	key ^= modifiers * 0x9E3779B9;
+	key ^= key >> 16;
+	key *= 0x85EBCA6B;
+	key ^= key >> 13;
+	key *= 0xC2B2AE35;
+	key ^= key >> 16;
+
+	return key;
 }
 
-void input_remove_hook( INPUT_EVENT event_id, input_handler_t handler )
+static KeyBindSlot* input_keytable_find( KeyBindTable* table, uint32 key, uint32 modifiers )
 {
-	node_t* node;
-	InputHookFunc* hook;
+	KeyBindSlot* slot;
+	uint32 mask, i;
 
-	if ( !input_initialized ) return;
-	if ( event_id >= NUM_INPUT_EVENTS ) return;
+	if ( key < KEYTABLE_DIRECT_SIZE && modifiers == 0 )
+		return &table->direct[key];
 
-	list_foreach( input_hooks[event_id], node )
+	if ( table->hashed == NULL ) return NULL;
+
+	mask = table->hashed_size - 1;
+
+	for ( i = input_keytable_hash( key, modifiers ) & mask;; i = ( i + 1 ) & mask )
 	{
-		hook = (InputHookFunc*)node;
-		if ( handler == hook->handler )
-		{
-			list_remove( input_hooks[event_id], node );
-			mem_free( hook );
+		slot = &table->hashed[i];
 
-			return;
-		}
+		if ( slot->binds == NULL ) return NULL;
+		if ( slot->key == key && slot->modifiers == modifiers ) return slot;
 	}
 }
 
-static KeyBind* input_add_key_bind( uint32 key, keybind_func_t func, void* data, BINDTYPE_KB type )
+static bool input_keytable_rehash( KeyBindTable* table )
 {
-	KeyBind* bind;
-	list_t* bindlist = NULL;
+	KeyBindSlot *old, *slot, *src;
+	uint32 old_size, size, mask, live, i, j;
 
-	if ( !input_initialized ) return NULL;
+	old = table->hashed;
+	old_size = table->hashed_size;
 
-	switch ( type )
+	// Size the new table for the keys which still have binds plus the one about to be added
+	for ( live = 1, i = 0; i < old_size; i++ )
 	{
-	case BIND_CHAR: bindlist = char_binds; break;
-	case BIND_KEYUP: bindlist = key_up_binds; break;
-	case BIND_KEYDOWN: bindlist = key_down_binds; break;
+		if ( old[i].count ) live++;
 	}
 
-	if ( bindlist == NULL ) return NULL;
+	for ( size = KEYTABLE_INITIAL_SIZE; live * 2 > size; size <<= 1 ) {}
 
-	bind = mem_alloc_clean( sizeof(*bind) );
-	bind->type = type;
-	bind->key = key;
-	bind->handler = func;
-	bind->userdata = data;
+	table->hashed = mem_alloc_clean( size * sizeof(*table->hashed) );
+	if ( table->hashed == NULL )
+	{
+		table->hashed = old;
+		return false;
+	}
 
-	list_push( bindlist, &bind->node );
+	table->hashed_size = size;
+	table->hashed_used = 0;
+	mask = size - 1;
 
-	return bind;
-}
+	// Rehash the old slots, dropping keys which no longer have any binds
+	for ( i = 0; i < old_size; i++ )
+	{
+		src = &old[i];
+		if ( src->binds == NULL ) continue;
 
-KeyBind* input_add_char_bind( uint32 key, keybind_func_t func, void* data )
-{
-	return input_add_key_bind( key, func, data, BIND_CHAR );
-}
+		if ( src->count == 0 )
+		{
+			mem_free( src->binds );
+			continue;
+		}
 
-KeyBind* input_add_key_up_bind( uint32 key, keybind_func_t func, void* data )
-{
-	return input_add_key_bind( key, func, data, BIND_KEYUP );
-}
+		for ( j = input_keytable_hash( src->key, src->modifiers ) & mask; table->hashed[j].binds; j = ( j + 1 ) & mask ) {}
 
-KeyBind* input_add_key_down_bind( uint32 key, keybind_func_t func, void* data )
-{
-	return input_add_key_bind( key, func, data, BIND_KEYDOWN );
+		slot = &table->hashed[j];
+		*slot = *src;
+		table->hashed_used++;
+	}
+
+	if ( old ) mem_free( old );
+
+	return true;
 }
 
-static MouseBind* input_add_mouse_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data, BINDTYPE_MOUSE type )
+static KeyBindSlot* input_keytable_get_slot( KeyBindTable* table, uint32 key, uint32 modifiers )
 {
-	MouseBind* bind;
-	list_t* bindlist = NULL;
+	KeyBindSlot* slot;
+	uint32 mask, i;
 
-	if ( !input_initialized ) return NULL;
+	slot = input_keytable_find( table, key, modifiers );
+	if ( slot != NULL ) return slot;
 
-	switch ( type )
+	// Keep the load factor of the hash below one half
+	if ( ( table->hashed_used + 1 ) * 2 > table->hashed_size )
 	{
-		case BIND_MOVE: bindlist = mouse_move_binds; break;
-		case BIND_BTNUP: bindlist = mouse_up_binds; break;
-		case BIND_BTNDOWN: bindlist = mouse_down_binds; break;
+		if ( !input_keytable_rehash( table ) ) return NULL;
 	}
 
-	if ( bindlist == NULL ) return NULL;
+	mask = table->hashed_size - 1;
+	for ( i = input_keytable_hash( key, modifiers ) & mask; table->hashed[i].binds; i = ( i + 1 ) & mask ) {}
 
-	bind = mem_alloc_clean( sizeof(*bind) );
-	bind->type = type;
-	bind->bounds = *area;
-	bind->button = button;
-	bind->handler = func;
-	bind->userdata = data;
-
-	list_push( bindlist, &bind->node );
-
-	return bind;
-}
+	slot = &table->hashed[i];
+	slot->key = key;
+	slot->modifiers = modifiers;
+	slot->count = 0;
+	slot->capacity = 4;
+	slot->binds = mem_alloc( slot->capacity * sizeof(*slot->binds) );
 
-MouseBind* input_add_mouse_move_bind( rectangle_t* area, mousebind_func_t func, void* data )
-{
-	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_MOVE );
-}
+	if ( slot->binds == NULL ) return NULL;
 
-MouseBind* input_add_mousebtn_up_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
-{
-	return input_add_mouse_bind( button, area, func, data, BIND_BTNUP );
-}
+	table->hashed_used++;
 
-MouseBind* input_add_mousebtn_down_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
-{
-	return input_add_mouse_bind( button, area, func, data, BIND_BTNDOWN );
+	return slot;
 }
 
-static void input_remove_key_bind_from_list( uint32 key, keybind_func_t func, BINDTYPE_KB type )
+static bool input_keytable_add( KeyBindTable* table, KeyBind* bind )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	list_t* bindlist = NULL;
+	KeyBindSlot* slot;
+	KeyBind** binds;
+	uint32 capacity;
 
-	if ( !input_initialized ) return;
+	slot = input_keytable_get_slot( table, bind->key, bind->modifiers );
+	if ( slot == NULL ) return false;
 
-	switch ( type )
+	if ( slot->count == slot->capacity )
 	{
-		case BIND_CHAR: bindlist = char_binds; break;
-		case BIND_KEYUP: bindlist = key_up_binds; break;
-		case BIND_KEYDOWN: bindlist = key_down_binds; break;
-	}
+		capacity = slot->capacity ? slot->capacity << 1 : 4;
+		binds = mem_alloc( capacity * sizeof(*binds) );
 
-	if ( bindlist == NULL ) return;
+		if ( binds == NULL ) return false;
 
-	list_foreach_safe( bindlist, node, tmp )
-	{
-		bind = (KeyBind*)node;
-		if ( bind->key == key && bind->handler == func )
+		if ( slot->binds )
 		{
-			list_remove( bindlist, node );
-			mem_free( bind );
+			memcpy( binds, slot->binds, slot->count * sizeof(*binds) );
+			mem_free( slot->binds );
 		}
+
+		slot->binds = binds;
+		slot->capacity = capacity;
 	}
-}
 
-void input_remove_char_bind( uint32 key, keybind_func_t func )
-{
-	input_remove_key_bind_from_list( key, func, BIND_CHAR );
-}
+	// Appending keeps the binds of a key in registration order
+	slot->binds[slot->count++] = bind;
 
-void input_remove_key_up_bind( uint32 key, keybind_func_t func )
-{
-	input_remove_key_bind_from_list( key, func, BIND_KEYUP );
+	return true;
 }
 
-void input_remove_key_down_bind( uint32 key, keybind_func_t func )
+static void input_keytable_remove_at( KeyBindSlot* slot, uint32 idx )
 {
-	input_remove_key_bind_from_list( key, func, BIND_KEYDOWN );
+	slot->count--;
+	memmove( &slot->binds[idx], &slot->binds[idx+1], ( slot->count - idx ) * sizeof(*slot->binds) );
 }
 
-void input_remove_key_bind( KeyBind* bind )
+static void input_keytable_remove( KeyBindTable* table, KeyBind* bind )
 {
-	input_remove_key_bind_from_list( bind->key, bind->handler, bind->type );
-}
+	KeyBindSlot* slot;
+	uint32 lo, hi, mid;
 
-static void input_remove_mouse_bind_from_list( MOUSEBTN button, mousebind_func_t func, BINDTYPE_MOUSE type )
-{
-	MouseBind* bind;
-	node_t *node, *tmp;
-	list_t* bindlist = NULL;
+	slot = input_keytable_find( table, bind->key, bind->modifiers );
+	if ( slot == NULL ) return;
 
-	if ( !input_initialized ) return;
+	// Binds of a key are sorted by their serial, find the bind with a binary search
+	lo = 0;
+	hi = slot->count;
 
-	switch ( type )
+	while ( lo < hi )
 	{
-		case BIND_MOVE: bindlist = mouse_move_binds; break;
-		case BIND_BTNUP: bindlist = mouse_up_binds; break;
-		case BIND_BTNDOWN: bindlist = mouse_down_binds; break;
+		mid = ( lo + hi ) >> 1;
+		if ( slot->binds[mid]->serial < bind->serial ) lo = mid + 1;
+		else hi = mid;
 	}
 
-	if ( bindlist == NULL ) return;
+	if ( lo < slot->count && slot->binds[lo] == bind )
+		input_keytable_remove_at( slot, lo );
+}
+
+static void input_keytable_destroy( KeyBindTable* table )
+{
+	KeyBindSlot* slot;
+	uint32 i;
 
-	list_foreach_safe( bindlist, node, tmp )
+	for ( i = 0; i < KEYTABLE_DIRECT_SIZE; i++ )
 	{
-		bind = (MouseBind*)node;
-		if ( bind->button == button && bind->handler != func )
-		{
-			list_remove( bindlist, node );
-			mem_free( bind );
-		}
+		slot = &table->direct[i];
+
+		if ( slot->binds ) mem_free( slot->binds );
 	}
-}
 
-void input_remove_mouse_move_bind( mousebind_func_t func )
-{
-	input_remove_mouse_bind_from_list( MOUSE_NONE, func, BIND_MOVE );
-}
+	for ( i = 0; i < table->hashed_size; i++ )
+	{
+		slot = &table->hashed[i];
 
-void input_remove_mousebtn_up_bind( MOUSEBTN button, mousebind_func_t func )
-{
-	input_remove_mouse_bind_from_list( button, func, BIND_BTNUP );
-}
+		if ( slot->binds ) mem_free( slot->binds );
+	}
 
-void input_remove_mousebtn_down_bind( MOUSEBTN button, mousebind_func_t func )
-{
-	input_remove_mouse_bind_from_list( button, func, BIND_BTNDOWN );
-}
+	if ( table->hashed ) mem_free( table->hashed );
 
-void input_remove_mouse_bind( MouseBind* bind )
-{
-	input_remove_mouse_bind_from_list( bind->button, bind->handler, bind->type );
+	memset( table, 0, sizeof(*table) );
 }
 
-void input_set_mousebind_button( MouseBind* bind, MOUSEBTN button )
+static bool input_keytable_dispatch( KeyBindTable* table, uint32 key, uint32 modifiers )
 {
-	if ( bind == NULL ) return;
-	bind->button = button;
-}
+	KeyBindSlot* slot;
+	KeyBind* bind;
+	uint32 i;
+	bool ret = true;
 
-void input_set_mousebind_rect( MouseBind* bind, rectangle_t* area )
-{
-	if ( bind == NULL ) return;
-	bind->bounds = *area;
-}
+	// Binds added or removed by the handlers are only linked or unlinked after the
+	// dispatch, so the slot stays as it is while it is walked
+	slot = input_keytable_find( table, key, modifiers );
+	if ( slot == NULL ) return true;
 
-void input_set_mousebind_func( MouseBind* bind, mousebind_func_t func )
-{
-	if ( bind == NULL ) return;
-	bind->handler = func;
-}
+	for ( i = 0; i < slot->count; i++ )
+	{
+		bind = slot->binds[i];
+		if ( !bind->disabled && !input_call_key_handler( bind, key ) ) ret = false;
+	}
 
-void input_set_mousebind_param( MouseBind* bind, void* data )
-{
-	if ( bind == NULL ) return;
-	bind->userdata = data;
+	return ret;
 }
 
-void input_block_keys( bool block )
+static int16 input_clamp_int16( int32 value )
 {
-	block_keys = block;
+	if ( value < -32768 ) return -32768;
+	if ( value > 32767 ) return 32767;
+	return (int16)value;
 }
 
-bool input_is_cursor_showing( void )
+static void input_mousecell_set_bounds( MouseBindCell* cell, uint32 idx, const rectangle_t* r )
 {
-	return show_cursor;
+	int32 x0, y0, x1, y1, tmp;
+
+	if ( r == NULL )
+	{
+		// Empty rectangle for the padding, never hit by any point
+		cell->bounds.x0[idx] = cell->bounds.y0[idx] = 32767;
+		cell->bounds.x1[idx] = cell->bounds.y1[idx] = -32768;
+		return;
+	}
+
+	x0 = r->x;
+	y0 = r->y;
+	x1 = x0 + r->w;
+	y1 = y0 + r->h;
+
+	if ( x1 < x0 ) { tmp = x0; x0 = x1; x1 = tmp; }
+	if ( y1 < y0 ) { tmp = y0; y0 = y1; y1 = tmp; }
+
+	// Bounds reaching past the int16 range are clamped, rect_is_point_in has the final say
+	cell->bounds.x0[idx] = input_clamp_int16( x0 );
+	cell->bounds.y0[idx] = input_clamp_int16( y0 );
+	cell->bounds.x1[idx] = input_clamp_int16( x1 );
+	cell->bounds.y1[idx] = input_clamp_int16( y1 );
 }
 
-void input_get_cursor_pos( int16* x, int16* y )
+static void input_mousecell_move( MouseBindCell* cell, uint32 dst, uint32 src, uint32 count )
 {
-	*x = mouse_x;
-	*y = mouse_y;
+	memmove( &cell->binds[dst], &cell->binds[src], count * sizeof(*cell->binds) );
+	memmove( &cell->bounds.x0[dst], &cell->bounds.x0[src], count * sizeof(int16) );
+	memmove( &cell->bounds.y0[dst], &cell->bounds.y0[src], count * sizeof(int16) );
+	memmove( &cell->bounds.x1[dst], &cell->bounds.x1[src], count * sizeof(int16) );
+	memmove( &cell->bounds.y1[dst], &cell->bounds.y1[src], count * sizeof(int16) );
 }
 
-bool input_handle_keyboard_event( INPUT_EVENT type, uint32 key )
+static bool input_mousecell_grow( MouseBindCell* cell )
 {
-	list_t* list;
-	node_t* node;
-	InputEvent event;
-	InputHookFunc* hook;
-
-	if ( !input_initialized ) return true;
-	if ( type >= NUM_INPUT_EVENTS ) return true;
+	MouseBindCell grown;
+	uint32 capacity, i;
+	uint8* block;
 
-	list = input_hooks[type];
+	capacity = cell->capacity ? cell->capacity << 1 : INPUT_HIT_BATCH;
 
-	if ( list_empty(list) ) return true;
+	// All the arrays of a cell share a single allocation
+	block = mem_alloc( capacity * ( sizeof(MouseBind*) + 4 * sizeof(int16) ) );
+	if ( block == NULL ) return false;
 
-	event.type = type;
-	event.keyboard.key = key;
+	grown.count = cell->count;
+	grown.capacity = capacity;
+	grown.binds = (MouseBind**)block;
+	grown.bounds.x0 = (int16*)( block + capacity * sizeof(MouseBind*) );
+	grown.bounds.y0 = grown.bounds.x0 + capacity;
+	grown.bounds.x1 = grown.bounds.y0 + capacity;
+	grown.bounds.y1 = grown.bounds.x1 + capacity;
 
-	list_foreach( list, node )
+	if ( cell->count )
 	{
-		hook = (InputHookFunc*)node;
-
-		if ( !hook->handler( &event ) )
-			return false;
+		memcpy( grown.binds, cell->binds, cell->count * sizeof(*cell->binds) );
+		memcpy( grown.bounds.x0, cell->bounds.x0, cell->count * sizeof(int16) );
+		memcpy( grown.bounds.y0, cell->bounds.y0, cell->count * sizeof(int16) );
+		memcpy( grown.bounds.x1, cell->bounds.x1, cell->count * sizeof(int16) );
+		memcpy( grown.bounds.y1, cell->bounds.y1, cell->count * sizeof(int16) );
 	}
 
-	if ( block_keys )
-		return false;
+	for ( i = cell->count; i < capacity; i++ )
+		input_mousecell_set_bounds( &grown, i, NULL );
+
+	if ( cell->binds ) mem_free( cell->binds );
+
+	*cell = grown;
 
 	return true;
 }
 
-bool input_handle_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+static bool input_mousecell_insert( MouseBindCell* cell, MouseBind* bind )
 {
-	list_t* list;
-	node_t* node;
-	InputEvent event;
-	InputHookFunc* hook;
-
-	if ( !input_initialized ) return true;
-	if ( type >= NUM_INPUT_EVENTS ) return true;
-
-	list = input_hooks[type];
-
-	if ( list_empty(list) ) return true;
+	uint32 lo, hi, mid;
 
-	event.type = type;
-	event.mouse.x = x;
-	event.mouse.y = y;
-	event.mouse.dx = x - mouse_x;
-	event.mouse.dy = y - mouse_y;
-	event.mouse.button = (uint8)button;
-	event.mouse.wheel = (uint8)wheel;
+	if ( cell->count == cell->capacity )
+	{
+		if ( !input_mousecell_grow( cell ) ) return false;
+	}
 
-	mouse_x = x;
-	mouse_y = y;
+	// New binds have the highest serial so they are simply appended, binds
+	// with updated bounds have to be inserted back to their original position.
+	lo = 0;
+	hi = cell->count;
 
-	list_foreach( list, node )
+	if ( hi && cell->binds[hi-1]->serial > bind->serial )
 	{
-		hook = (InputHookFunc*)node;
+		while ( lo < hi )
+		{
+			mid = ( lo + hi ) >> 1;
+			if ( cell->binds[mid]->serial < bind->serial ) lo = mid + 1;
+			else hi = mid;
+		}
 
-		if ( !hook->handler( &event ) )
-			return false;
+		input_mousecell_move( cell, lo + 1, lo, cell->count - lo );
+	}
+	else
+	{
+		lo = hi;
 	}
 
+	cell->binds[lo] = bind;
+	input_mousecell_set_bounds( cell, lo, &bind->bounds );
+	cell->count++;
+
 	return true;
 }
 
-bool input_handle_char_bind( uint32 key )
+static void input_mousecell_remove( MouseBindCell* cell, MouseBind* bind )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	uint32 lo = 0, hi = cell->count, mid;
 
-	if ( !input_initialized ) return true;
-
-	list_foreach_safe( char_binds, node, tmp )
+	while ( lo < hi )
 	{
-		bind = (KeyBind*)node;
-		if ( !bind->handler( key, bind->userdata ) )
-		{
-			ret = false;
-		}
+		mid = ( lo + hi ) >> 1;
+		if ( cell->binds[mid]->serial < bind->serial ) lo = mid + 1;
+		else hi = mid;
 	}
 
-	return ret;
+	if ( lo < cell->count && cell->binds[lo] == bind )
+	{
+		cell->count--;
+		input_mousecell_move( cell, lo, lo + 1, cell->count - lo );
+		input_mousecell_set_bounds( cell, cell->count, NULL );
+	}
 }
 
-bool input_handle_key_down_bind( uint32 key )
+static void input_mouseindex_insert( MouseBindIndex* index, MouseBind* bind )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	int32 x0, y0, x1, y1, cx, cy;
+	const int32 limit = MOUSEGRID_SIZE << MOUSEGRID_CELL_SHIFT;
 
-	if ( !input_initialized ) return true;
-
-	list_foreach_safe( key_down_binds, node, tmp )
-	{
-		bind = (KeyBind*)node;
-		if ( key == bind->key )
-		{
-			if ( !bind->handler( key, bind->userdata ) ) ret = false;
-		}
-	}
+	x0 = bind->bounds.x;
+	y0 = bind->bounds.y;
+	x1 = x0 + bind->bounds.w;
+	y1 = y0 + bind->bounds.h;
 
-	return ret;
-}
+	if ( x1 < x0 ) { cx = x0; x0 = x1; x1 = cx; }
+	if ( y1 < y0 ) { cy = y0; y0 = y1; y1 = cy; }
 
-bool input_handle_key_up_bind( uint32 key )
-{
-	KeyBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	bind->cell_x0 = -1;
 
-	if ( !input_initialized ) return true;
+	// The grid is only allocated once a layer gets its first bind
+	if ( index->cells == NULL )
+		index->cells = mem_alloc_clean( MOUSEGRID_SIZE * MOUSEGRID_SIZE * sizeof(*index->cells) );
 
-	list_foreach_safe( key_up_binds, node, tmp )
+	if ( index->cells && x0 >= 0 && y0 >= 0 && x1 < limit && y1 < limit )
 	{
-		bind = (KeyBind*)node;
-		if ( key == bind->key )
+		x0 >>= MOUSEGRID_CELL_SHIFT;
+		y0 >>= MOUSEGRID_CELL_SHIFT;
+		x1 >>= MOUSEGRID_CELL_SHIFT;
+		y1 >>= MOUSEGRID_CELL_SHIFT;
+
+		if ( ( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) <= MOUSEGRID_MAX_CELLS )
 		{
-			if ( !bind->handler( key, bind->userdata ) ) ret = false;
+			for ( cy = y0; cy <= y1; cy++ )
+			{
+				for ( cx = x0; cx <= x1; cx++ )
+				{
+					if ( !input_mousecell_insert( &index->cells[cy * MOUSEGRID_SIZE + cx], bind ) )
+						goto fail;
+				}
+			}
+
+			bind->cell_x0 = (int16)x0;
+			bind->cell_y0 = (int16)y0;
+			bind->cell_x1 = (int16)x1;
+			bind->cell_y1 = (int16)y1;
+
+			return;
+
+		fail:
+			// Out of memory, undo the partial insert and fall back to the overflow cell
+			for ( cy = y0; cy <= y1; cy++ )
+			{
+				for ( cx = x0; cx <= x1; cx++ )
+					input_mousecell_remove( &index->cells[cy * MOUSEGRID_SIZE + cx], bind );
+			}
+		}
+	}
+
+	input_mousecell_insert( &index->overflow, bind );
+}
+
+static void input_mouseindex_remove( MouseBindIndex* index, MouseBind* bind )
+{
+	int32 cx, cy;
+
+	if ( bind->cell_x0 < 0 )
+	{
+		input_mousecell_remove( &index->overflow, bind );
+		return;
+	}
+
+	for ( cy = bind->cell_y0; cy <= bind->cell_y1; cy++ )
+	{
+		for ( cx = bind->cell_x0; cx <= bind->cell_x1; cx++ )
+			input_mousecell_remove( &index->cells[cy * MOUSEGRID_SIZE + cx], bind );
+	}
+}
+
+static void input_mouseindex_create( MouseBindIndex* index )
+{
+	index->binds = list_create();
+	index->cells = NULL;
+	memset( &index->overflow, 0, sizeof(index->overflow) );
+}
+
+static void input_mouseindex_destroy( MouseBindIndex* index )
+{
+	uint32 i;
+
+	if ( index->cells )
+	{
+		for ( i = 0; i < MOUSEGRID_SIZE * MOUSEGRID_SIZE; i++ )
+		{
+			if ( index->cells[i].binds ) mem_free( index->cells[i].binds );
+		}
+
+		mem_free( index->cells );
+	}
+
+	if ( index->overflow.binds ) mem_free( index->overflow.binds );
+
+	list_destroy( index->binds );
+	memset( index, 0, sizeof(*index) );
+}
+
+// Iterates over the binds of a cell which contain the given point
+typedef struct {
+	MouseBindCell*	cell;
+	uint32			base;			// Index of the first bind in the current batch
+	uint32			next;			// Index of the next batch to test
+	uint32			mask;			// Remaining hits in the current batch
+} MouseHitCursor;
+
+static void input_mousecursor_init( MouseHitCursor* cursor, MouseBindCell* cell )
+{
+	cursor->cell = cell;
+	cursor->base = 0;
+	cursor->next = 0;
+	cursor->mask = 0;
+}
+
+static MouseBind* input_mousecursor_peek( MouseHitCursor* cursor, int16 x, int16 y )
+{
+	MouseBindCell* cell = cursor->cell;
+
+	while ( cursor->mask == 0 )
+	{
+		if ( cell == NULL || cursor->next >= cell->count ) return NULL;
+
+		cursor->base = cursor->next;
+		cursor->mask = input_hit_test( &cell->bounds, cursor->base, x, y );
+		cursor->next += INPUT_HIT_BATCH;
+	}
+
+	return cell->binds[cursor->base + input_ctz32( cursor->mask )];
+}
+
+static uint32 input_mouseindex_query( MouseBindIndex* index, int16 x, int16 y, MOUSEBTN button,
+									  uint32 first, MouseBind** hits, uint32 max_hits )
+{
+	MouseHitCursor cell, overflow;
+	MouseBind *a, *b, *bind;
+	uint32 count = 0;
+
+	input_mousecursor_init( &cell, NULL );
+	input_mousecursor_init( &overflow, &index->overflow );
+
+	if ( index->cells && x >= 0 && y >= 0 && ( x >> MOUSEGRID_CELL_SHIFT ) < MOUSEGRID_SIZE && ( y >> MOUSEGRID_CELL_SHIFT ) < MOUSEGRID_SIZE )
+		cell.cell = &index->cells[( y >> MOUSEGRID_CELL_SHIFT ) * MOUSEGRID_SIZE + ( x >> MOUSEGRID_CELL_SHIFT )];
+
+	// Merge the hits of the grid cell and the overflow cell so that they stay in registration order
+	for ( ;; )
+	{
+		a = input_mousecursor_peek( &cell, x, y );
+		b = input_mousecursor_peek( &overflow, x, y );
+
+		if ( a && ( b == NULL || a->serial < b->serial ) )
+		{
+			bind = a;
+			cell.mask &= cell.mask - 1;
+		}
+		else if ( b )
+		{
+			bind = b;
+			overflow.mask &= overflow.mask - 1;
+		}
+		else
+		{
+			break;
+		}
+
+		if ( bind->disabled ) continue;
+		if ( button != MOUSE_NONE && bind->button != button ) continue;
+
+		// The vectorized test uses int16 clamped bounds, confirm the hit with the exact test
+		if ( !rect_is_point_in( &bind->bounds, x, y ) ) continue;
+
+		// Hits before the first one are only counted
+		if ( count >= first && count - first < max_hits ) hits[count - first] = bind;
+		count++;
+	}
+
+	return count;
+}
+
+static bool input_mouseindex_dispatch( MouseBindIndex* index, MOUSEBTN button, int16 x, int16 y )
+{
+	MouseBind* stack_hits[MOUSEGRID_STACK_HITS];
+	MouseBind** hits = stack_hits;
+	uint32 count, first, batch, i;
+	bool ret = true;
+
+	// Collect the hits before calling any handlers. Changes made by the handlers are
+	// deferred until the dispatch is over, so querying again gives the same hits.
+	count = input_mouseindex_query( index, x, y, button, 0, hits, MOUSEGRID_STACK_HITS );
+
+	if ( count > MOUSEGRID_STACK_HITS )
+	{
+		hits = mem_alloc( count * sizeof(*hits) );
+
+		if ( hits != NULL ) input_mouseindex_query( index, x, y, button, 0, hits, count );
+		else hits = stack_hits;
+	}
+
+	// Without memory for all the hits they are dispatched a stack buffer at a time
+	for ( first = 0; first < count; first += batch )
+	{
+		batch = hits == stack_hits && count - first > MOUSEGRID_STACK_HITS ? MOUSEGRID_STACK_HITS : count - first;
+
+		if ( first ) input_mouseindex_query( index, x, y, button, first, hits, batch );
+
+		for ( i = 0; i < batch; i++ )
+		{
+			if ( !input_call_mouse_handler( hits[i], button, x, y ) ) ret = false;
+		}
+	}
+
+	if ( hits != stack_hits ) mem_free( hits );
+
+	return ret;
+}
+
+static void input_layer_create( InputLayer* layer, const char* name, uint32 flags )
+{
+	memset( layer, 0, sizeof(*layer) );
+
+	strncpy( layer->name, name, sizeof(layer->name) - 1 );
+	layer->flags = flags;
+	layer->created = true;
+	layer->enabled = true;
+
+	layer->char_binds = list_create();
+	layer->sequence_binds = list_create();
+	input_mouseindex_create( &layer->mouse_up_binds );
+	input_mouseindex_create( &layer->mouse_down_binds );
+	input_mouseindex_create( &layer->mouse_move_binds );
+}
+
+static void input_layer_destroy( InputLayer* layer )
+{
+	node_t* node;
+
+	if ( !layer->created ) return;
+
+	// The binds themselves are released along with the pool, but the keys are not
+	list_foreach( layer->sequence_binds, node )
+		mem_free( ((KeyBind*)node)->sequence );
+
+	list_destroy( layer->char_binds );
+	list_destroy( layer->sequence_binds );
+	input_keytable_destroy( &layer->key_up_binds );
+	input_keytable_destroy( &layer->key_down_binds );
+	input_keytable_destroy( &layer->chord_binds );
+	input_mouseindex_destroy( &layer->mouse_up_binds );
+	input_mouseindex_destroy( &layer->mouse_down_binds );
+	input_mouseindex_destroy( &layer->mouse_move_binds );
+
+	memset( layer, 0, sizeof(*layer) );
+}
+
+static KeyBindTable* input_get_key_table( InputLayer* layer, BINDTYPE_KB type )
+{
+	switch ( type )
+	{
+		case BIND_KEYUP: return &layer->key_up_binds;
+		case BIND_KEYDOWN: return &layer->key_down_binds;
+		case BIND_CHORD: return &layer->chord_binds;
+		default: return NULL;
+	}
+}
+
+static MouseBindIndex* input_get_mouse_index( InputLayer* layer, BINDTYPE_MOUSE type )
+{
+	switch ( type )
+	{
+		case BIND_MOVE: return &layer->mouse_move_binds;
+		case BIND_BTNUP: return &layer->mouse_up_binds;
+		case BIND_BTNDOWN: return &layer->mouse_down_binds;
+	}
+
+	return NULL;
+}
+
+static void input_apply_ops( void );
+
+static bool input_is_input_thread( void )
+{
+	return input_atomic_load_ptr( &context->input_thread ) == &thread_token;
+}
+
+// Can the bind tables be modified right away
+static bool input_can_modify( void )
+{
+	return input_is_input_thread() && context->dispatch_depth == 0;
+}
+
+// Layer of a bind being added. It is picked when the bind is added, not when it is linked.
+// The bind layer can only be changed by the dispatching thread, other threads add to the
+// default layer.
+static uint32 input_get_registration_layer( void )
+{
+	return input_is_input_thread() ? context->bind_layer : INPUT_DEFAULT_LAYER;
+}
+
+static InputOp* input_create_op( INPUT_OP type )
+{
+	InputOp* op;
+
+	op = mem_alloc_clean( sizeof(*op) );
+	if ( op != NULL ) op->type = type;
+
+	return op;
+}
+
+static void input_post_op( InputOp* op )
+{
+	InputOp* head;
+
+	if ( input_is_input_thread() )
+	{
+		// Deferred by a handler, no other thread touches this list
+		op->next = NULL;
+
+		if ( context->deferred_tail ) context->deferred_tail->next = op;
+		else context->deferred_ops = op;
+
+		context->deferred_tail = op;
+		return;
+	}
+
+	// Ops are pushed to the front, input_take_ops reverses them back to the posting order
+	do
+	{
+		head = input_atomic_load_ptr( &context->pending_ops );
+		op->next = head;
+	}
+	while ( !input_atomic_cas_ptr( &context->pending_ops, head, op ) );
+}
+
+static InputOp* input_take_ops( void )
+{
+	InputOp *op, *next, *ops = NULL;
+
+	// Reverse the ops of other threads back to the order they were posted in
+	for ( op = input_atomic_exchange_ptr( &context->pending_ops, NULL ); op != NULL; op = next )
+	{
+		next = op->next;
+		op->next = ops;
+		ops = op;
+	}
+
+	// Ops deferred during dispatch go first
+	if ( context->deferred_tail )
+	{
+		context->deferred_tail->next = ops;
+		ops = context->deferred_ops;
+	}
+
+	context->deferred_ops = context->deferred_tail = NULL;
+
+	return ops;
+}
+
+static void input_discard_ops( void )
+{
+	InputOp *op, *next;
+
+	// Unlinked binds go away with the pools, only their sequences have to be released
+	for ( op = input_take_ops(); op != NULL; op = next )
+	{
+		next = op->next;
+
+		if ( op->type == OP_LINK_KEY_BIND && op->key_bind->sequence )
+			mem_free( op->key_bind->sequence );
+
+		mem_free( op );
+	}
+}
+
+// --------------------------------------------------
+
+InputContextState* input_context_state( void )
+{
+	return &context->shared;
+}
+
+bool input_is_default_context( void )
+{
+	return context == &default_context;
+}
+
+input_context_t* input_create_context( void* window )
+{
+	input_context_t *ctx, *prev;
+
+	if ( !window ) return NULL;
+
+	ctx = mem_alloc_clean( sizeof(*ctx) );
+	if ( ctx == NULL ) return NULL;
+
+	// The context is initialized like the default one, by the calling thread
+	prev = input_set_context( ctx );
+	input_initialize( window );
+	input_set_context( prev );
+
+	return ctx;
+}
+
+void input_destroy_context( input_context_t* ctx )
+{
+	input_context_t* prev;
+
+	if ( ctx == NULL || ctx == &default_context ) return;
+
+	prev = input_set_context( ctx );
+	input_shutdown();
+	input_set_context( prev != ctx ? prev : NULL );
+
+	mem_free( ctx );
+}
+
+input_context_t* input_set_context( input_context_t* ctx )
+{
+	input_context_t* prev = context;
+
+	context = ctx != NULL ? ctx : &default_context;
+
+	return prev;
+}
+
+input_context_t* input_get_context( void )
+{
+	return context;
+}
+
+void input_set_dispatch_thread( void )
+{
+	if ( !context->initialized || input_is_input_thread() ) return;
+
+	// Changes made by other threads from now on, including the previous owner, go
+	// through the op list and are applied by this thread
+	input_atomic_store_ptr( &context->input_thread, &thread_token );
+}
+
+void input_initialize( void* window )
+{
+	uint32 i;
+
+	if ( !window ) return;
+
+	// Binds and hooks are linked by the thread initializing the context until another
+	// thread starts dispatching the events
+	input_atomic_store_ptr( &context->input_thread, &thread_token );
+
+	// Initialize the pools bind and hook structs are allocated from
+	input_pool_create( &context->keybind_pool, sizeof(KeyBind) );
+	input_pool_create( &context->mousebind_pool, sizeof(MouseBind) );
+	input_pool_create( &context->hook_pool, sizeof(InputHookFunc) );
+	input_automaton_create( &context->sequence_fsm );
+
+	// Initialize hook lists
+	for ( i = NUM_INPUT_EVENTS; i--; )
+		context->input_hooks[i] = list_create();
+
+	// Initialize key/mouse binds, the default layer is always active
+	input_layer_create( &context->layers[INPUT_DEFAULT_LAYER], "default", 0 );
+
+	context->layer_stack[0] = INPUT_DEFAULT_LAYER;
+	context->layer_stack_size = 1;
+	context->layers[INPUT_DEFAULT_LAYER].stacked = true;
+	context->bind_layer = INPUT_DEFAULT_LAYER;
+	context->shared.show_cursor = true;
+
+	// Do window system specific initializing (event hooks etc)
+	input_platform_initialize( window );
+
+	input_hit_test_initialize();
+
+	context->initialized = true;
+}
+
+void input_shutdown( void )
+{
+	uint32 i;
+
+	if ( !context->initialized ) return;
+
+	// Destroy input hook lists
+	for ( i = NUM_INPUT_EVENTS; i--; )
+	{
+		if ( context->input_hooks[i] != NULL )
+		{
+			list_destroy( context->input_hooks[i] );
+			context->input_hooks[i] = NULL;
+		}
+	}
+
+	// Destroy key/mouse binds
+	for ( i = 0; i < INPUT_MAX_LAYERS; i++ )
+		input_layer_destroy( &context->layers[i] );
+
+	// Release the cursor before the platform implementation goes away
+	input_set_relative_mouse( false );
+
+	context->layer_stack_size = 0;
+	context->modifier_state = 0;
+	context->modifier_key_down = false;
+	input_state_reset();
+	context->capture_time = 0;
+	context->event_time = 0;
+	context->event_modifiers = 0;
+	context->event_modifier_key = false;
+	context->key_consumed = false;
+	context->coalesce_motion = false;
+	context->motion_pending = false;
+	context->relative_mouse = false;
+
+	input_queue_shutdown();
+
+	// Recording and the diagnostics belong to the default context
+	if ( input_is_default_context() )
+	{
+		input_trace_shutdown();
+		input_latency_shutdown();
+		input_timeline_shutdown();
+	}
+
+	input_automaton_destroy( &context->sequence_fsm );
+	context->sequences_dirty = false;
+
+	// Release all binds and hooks at once
+	input_discard_ops();
+	input_pool_destroy( &context->keybind_pool );
+	input_pool_destroy( &context->mousebind_pool );
+	input_pool_destroy( &context->hook_pool );
+
+	// Do window system specific cleanup
+	input_platform_shutdown();
+
+	context->initialized = false;
+}
+
+static void input_link_hook( InputHookFunc* hook, INPUT_EVENT event_id )
+{
+	list_push( context->input_hooks[event_id], &hook->node );
+}
+
+static void input_unlink_hook( INPUT_EVENT event_id, input_handler_t handler )
+{
+	node_t* node;
+	InputHookFunc* hook;
+
+	list_foreach( context->input_hooks[event_id], node )
+	{
+		hook = (InputHookFunc*)node;
+		if ( handler == hook->handler )
+		{
+			list_remove( context->input_hooks[event_id], node );
+			input_pool_free( &context->hook_pool, hook );
+
+			return;
+		}
+	}
+}
+
+void input_add_hook( INPUT_EVENT event_id, input_handler_t handler )
+{
+	InputHookFunc* hook;
+	InputOp* op;
+
+	if ( !context->initialized ) return;
+	if ( event_id >= NUM_INPUT_EVENTS ) return;
+
+	hook = input_pool_alloc( &context->hook_pool );
+	if ( hook == NULL ) return;
+
+	hook->handler = handler;
+#ifdef INPUT_PROFILE
+	hook->event = event_id;
+#endif
+
+	if ( input_can_modify() )
+	{
+		// Registrations posted earlier by other threads go first
+		input_apply_ops();
+		input_link_hook( hook, event_id );
+		return;
+	}
+
+	if ( ( op = input_create_op( OP_LINK_HOOK ) ) == NULL )
+	{
+		input_pool_free( &context->hook_pool, hook );
+		return;
+	}
+
+	op->hook.hook = hook;
+	op->hook.event = event_id;
+	input_post_op( op );
+}
+
+void input_remove_hook( INPUT_EVENT event_id, input_handler_t handler )
+{
+	InputOp* op;
+
+	if ( !context->initialized ) return;
+	if ( event_id >= NUM_INPUT_EVENTS ) return;
+
+	if ( input_can_modify() )
+	{
+		input_apply_ops();
+		input_unlink_hook( event_id, handler );
+		return;
+	}
+
+	if ( ( op = input_create_op( OP_REMOVE_HOOK ) ) == NULL ) return;
+
+	op->hook.event = event_id;
+	op->hook.handler = handler;
+	input_post_op( op );
+}
+
+static bool input_link_key_bind( KeyBind* bind )
+{
+	KeyBindTable* table;
+	InputLayer* layer;
+
+	layer = &context->layers[bind->layer];
+
+	bind->serial = context->bind_serial++;
+
+	if ( bind->type == BIND_CHAR )
+	{
+		list_push( layer->char_binds, &bind->node );
+		return true;
+	}
+
+	if ( bind->type == BIND_SEQUENCE )
+	{
+		list_push( layer->sequence_binds, &bind->node );
+		context->sequences_dirty = true;
+		return true;
+	}
+
+	table = input_get_key_table( layer, bind->type );
+
+	if ( table == NULL || !input_keytable_add( table, bind ) )
+	{
+		input_pool_free( &context->keybind_pool, bind );
+		return false;
+	}
+
+	return true;
+}
+
+static KeyBind* input_register_key_bind( KeyBind* bind )
+{
+	InputOp* op;
+
+	bind->layer = (uint8)input_get_registration_layer();
+
+	if ( input_can_modify() )
+	{
+		// Binds posted earlier by other threads are linked first to keep the registration order
+		input_apply_ops();
+		return input_link_key_bind( bind ) ? bind : NULL;
+	}
+
+	// Binds registered from other threads are valid right away but they are not
+	// called before the input thread has linked them
+	if ( ( op = input_create_op( OP_LINK_KEY_BIND ) ) == NULL )
+	{
+		if ( bind->sequence ) mem_free( bind->sequence );
+		input_pool_free( &context->keybind_pool, bind );
+		return NULL;
+	}
+
+	op->key_bind = bind;
+	input_post_op( op );
+
+	return bind;
+}
+
+static KeyBind* input_add_key_bind( uint32 key, uint32 modifiers, keybind_func_t func, void* data, BINDTYPE_KB type )
+{
+	KeyBind* bind;
+
+	if ( !context->initialized ) return NULL;
+
+	bind = input_pool_alloc( &context->keybind_pool );
+	if ( bind == NULL ) return NULL;
+
+	bind->type = type;
+	bind->key = key;
+	bind->modifiers = modifiers;
+	bind->handler = func;
+	bind->userdata = data;
+
+	return input_register_key_bind( bind );
+}
+
+KeyBind* input_add_char_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, 0, func, data, BIND_CHAR );
+}
+
+KeyBind* input_add_key_up_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, 0, func, data, BIND_KEYUP );
+}
+
+KeyBind* input_add_key_down_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, 0, func, data, BIND_KEYDOWN );
+}
+
+KeyBind* input_add_chord_bind( uint32 key, uint32 modifiers, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, input_chord_modifiers( modifiers ), func, data, BIND_CHORD );
+}
+
+KeyBind* input_add_sequence_bind( const InputKeyStroke* keys, uint32 count, uint32 timeout, keybind_func_t func, void* data )
+{
+	KeyBind* bind;
+	KeySequence* sequence;
+	uint32 i;
+
+	if ( !context->initialized ) return NULL;
+	if ( keys == NULL || count == 0 || count > INPUT_MAX_SEQUENCE_LENGTH ) return NULL;
+
+	sequence = mem_alloc( sizeof(*sequence) );
+	if ( sequence == NULL ) return NULL;
+
+	bind = input_pool_alloc( &context->keybind_pool );
+	if ( bind == NULL )
+	{
+		mem_free( sequence );
+		return NULL;
+	}
+
+	sequence->length = count;
+	sequence->timeout = timeout;
+
+	for ( i = 0; i < count; i++ )
+	{
+		sequence->keys[i].key = keys[i].key;
+		sequence->keys[i].modifiers = input_chord_modifiers( keys[i].modifiers );
+	}
+
+	// The bind is called with the last key of the sequence
+	bind->type = BIND_SEQUENCE;
+	bind->key = sequence->keys[count-1].key;
+	bind->modifiers = sequence->keys[count-1].modifiers;
+	bind->handler = func;
+	bind->userdata = data;
+	bind->sequence = sequence;
+
+	return input_register_key_bind( bind );
+}
+
+static void input_link_mouse_bind( MouseBind* bind )
+{
+	MouseBindIndex* index;
+
+	index = input_get_mouse_index( &context->layers[bind->layer], bind->type );
+
+	bind->serial = context->bind_serial++;
+
+	list_push( index->binds, &bind->node );
+	input_mouseindex_insert( index, bind );
+}
+
+static MouseBind* input_add_mouse_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data, BINDTYPE_MOUSE type )
+{
+	MouseBind* bind;
+	InputOp* op;
+
+	if ( !context->initialized ) return NULL;
+
+	bind = input_pool_alloc( &context->mousebind_pool );
+	if ( bind == NULL ) return NULL;
+
+	bind->type = type;
+	bind->bounds = *area;
+	bind->button = button;
+	bind->handler = func;
+	bind->userdata = data;
+	bind->layer = (uint8)input_get_registration_layer();
+
+	if ( input_can_modify() )
+	{
+		// Binds posted earlier by other threads are linked first to keep the registration order
+		input_apply_ops();
+		input_link_mouse_bind( bind );
+		return bind;
+	}
+
+	if ( ( op = input_create_op( OP_LINK_MOUSE_BIND ) ) == NULL )
+	{
+		input_pool_free( &context->mousebind_pool, bind );
+		return NULL;
+	}
+
+	op->mouse_bind = bind;
+	input_post_op( op );
+
+	return bind;
+}
+
+MouseBind* input_add_mouse_move_bind( rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_MOVE );
+}
+
+MouseBind* input_add_mousebtn_up_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( button, area, func, data, BIND_BTNUP );
+}
+
+MouseBind* input_add_mousebtn_down_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( button, area, func, data, BIND_BTNDOWN );
+}
+
+static void input_unlink_key_binds( uint32 key, uint32 modifiers, keybind_func_t func, BINDTYPE_KB type )
+{
+	KeyBind* bind;
+	KeyBindSlot* slot;
+	InputLayer* layer;
+	node_t *node, *tmp;
+	uint32 i, j;
+
+	// Matching binds are removed from every layer
+	for ( j = 0; j < INPUT_MAX_LAYERS; j++ )
+	{
+		layer = &context->layers[j];
+		if ( !layer->created ) continue;
+
+		if ( type == BIND_CHAR )
+		{
+			list_foreach_safe( layer->char_binds, node, tmp )
+			{
+				bind = (KeyBind*)node;
+				if ( bind->key == key && bind->handler == func )
+				{
+					list_remove( layer->char_binds, node );
+					input_pool_free( &context->keybind_pool, bind );
+				}
+			}
+
+			continue;
+		}
+
+		slot = input_keytable_find( input_get_key_table( layer, type ), key, modifiers );
+		if ( slot == NULL ) continue;
+
+		for ( i = slot->count; i--; )
+		{
+			bind = slot->binds[i];
+			if ( bind->handler == func )
+			{
+				input_keytable_remove_at( slot, i );
+				input_pool_free( &context->keybind_pool, bind );
+			}
+		}
+	}
+}
+
+static void input_remove_key_binds( uint32 key, uint32 modifiers, keybind_func_t func, BINDTYPE_KB type )
+{
+	InputOp* op;
+
+	if ( !context->initialized ) return;
+
+	if ( input_can_modify() )
+	{
+		input_apply_ops();
+		input_unlink_key_binds( key, modifiers, func, type );
+		return;
+	}
+
+	if ( ( op = input_create_op( OP_REMOVE_KEY_BINDS ) ) == NULL ) return;
+
+	op->keys.key = key;
+	op->keys.modifiers = modifiers;
+	op->keys.func = func;
+	op->keys.type = type;
+	input_post_op( op );
+}
+
+void input_remove_char_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_binds( key, 0, func, BIND_CHAR );
+}
+
+void input_remove_key_up_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_binds( key, 0, func, BIND_KEYUP );
+}
+
+void input_remove_key_down_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_binds( key, 0, func, BIND_KEYDOWN );
+}
+
+void input_remove_chord_bind( uint32 key, uint32 modifiers, keybind_func_t func )
+{
+	input_remove_key_binds( key, input_chord_modifiers( modifiers ), func, BIND_CHORD );
+}
+
+static bool input_sequence_equals( const KeySequence* sequence, const InputKeyStroke* keys, uint32 count )
+{
+	uint32 i;
+
+	if ( sequence->length != count ) return false;
+
+	for ( i = 0; i < count; i++ )
+	{
+		if ( sequence->keys[i].key != keys[i].key ) return false;
+		if ( sequence->keys[i].modifiers != input_chord_modifiers( keys[i].modifiers ) ) return false;
+	}
+
+	return true;
+}
+
+static void input_unlink_key_bind( KeyBind* bind )
+{
+	// Unlink only the given bind, other binds sharing the key and handler stay registered
+	if ( bind->type == BIND_CHAR )
+	{
+		list_remove( context->layers[bind->layer].char_binds, &bind->node );
+	}
+	else if ( bind->type == BIND_SEQUENCE )
+	{
+		list_remove( context->layers[bind->layer].sequence_binds, &bind->node );
+		mem_free( bind->sequence );
+		context->sequences_dirty = true;
+	}
+	else
+	{
+		input_keytable_remove( input_get_key_table( &context->layers[bind->layer], bind->type ), bind );
+	}
+
+	input_pool_free( &context->keybind_pool, bind );
+}
+
+static void input_unlink_sequence_binds( const InputKeyStroke* keys, uint32 count, keybind_func_t func )
+{
+	KeyBind* bind;
+	node_t *node, *tmp;
+	uint32 i;
+
+	for ( i = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( !context->layers[i].created ) continue;
+
+		list_foreach_safe( context->layers[i].sequence_binds, node, tmp )
+		{
+			bind = (KeyBind*)node;
+			if ( bind->handler == func && input_sequence_equals( bind->sequence, keys, count ) )
+				input_unlink_key_bind( bind );
+		}
+	}
+}
+
+void input_remove_sequence_bind( const InputKeyStroke* keys, uint32 count, keybind_func_t func )
+{
+	InputOp* op;
+
+	if ( !context->initialized ) return;
+	if ( keys == NULL || count > INPUT_MAX_SEQUENCE_LENGTH ) return;
+
+	if ( input_can_modify() )
+	{
+		input_apply_ops();
+		input_unlink_sequence_binds( keys, count, func );
+		return;
+	}
+
+	if ( ( op = input_create_op( OP_REMOVE_SEQUENCE_BINDS ) ) == NULL ) return;
+
+	memcpy( op->sequence.keys, keys, count * sizeof(*keys) );
+	op->sequence.count = count;
+	op->sequence.func = func;
+	input_post_op( op );
+}
+
+static void input_remove_bind_later( input_bind_t handle )
+{
+	InputOp* op;
+
+	if ( ( op = input_create_op( OP_REMOVE_BIND ) ) == NULL ) return;
+
+	op->handle = handle;
+	input_post_op( op );
+}
+
+void input_remove_key_bind( KeyBind* bind )
+{
+	if ( !context->initialized ) return;
+	if ( bind == NULL ) return;
+
+	if ( !input_can_modify() )
+	{
+		input_remove_bind_later( input_get_key_bind_handle( bind ) );
+		return;
+	}
+
+	input_apply_ops();
+	input_unlink_key_bind( bind );
+}
+
+static void input_unlink_mouse_binds( MOUSEBTN button, mousebind_func_t func, BINDTYPE_MOUSE type )
+{
+	MouseBind* bind;
+	node_t *node, *tmp;
+	MouseBindIndex* index;
+	uint32 i;
+
+	// Matching binds are removed from every layer
+	for ( i = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( !context->layers[i].created ) continue;
+
+		index = input_get_mouse_index( &context->layers[i], type );
+		if ( index == NULL ) return;
+
+		list_foreach_safe( index->binds, node, tmp )
+		{
+			bind = (MouseBind*)node;
+			if ( bind->button == button && bind->handler == func )
+			{
+				input_mouseindex_remove( index, bind );
+				list_remove( index->binds, node );
+				input_pool_free( &context->mousebind_pool, bind );
+			}
+		}
+	}
+}
+
+static void input_remove_mouse_binds( MOUSEBTN button, mousebind_func_t func, BINDTYPE_MOUSE type )
+{
+	InputOp* op;
+
+	if ( !context->initialized ) return;
+
+	if ( input_can_modify() )
+	{
+		input_apply_ops();
+		input_unlink_mouse_binds( button, func, type );
+		return;
+	}
+
+	if ( ( op = input_create_op( OP_REMOVE_MOUSE_BINDS ) ) == NULL ) return;
+
+	op->mouse.button = button;
+	op->mouse.func = func;
+	op->mouse.type = type;
+	input_post_op( op );
+}
+
+void input_remove_mouse_move_bind( mousebind_func_t func )
+{
+	input_remove_mouse_binds( MOUSE_NONE, func, BIND_MOVE );
+}
+
+void input_remove_mousebtn_up_bind( MOUSEBTN button, mousebind_func_t func )
+{
+	input_remove_mouse_binds( button, func, BIND_BTNUP );
+}
+
+void input_remove_mousebtn_down_bind( MOUSEBTN button, mousebind_func_t func )
+{
+	input_remove_mouse_binds( button, func, BIND_BTNDOWN );
+}
+
+static void input_unlink_mouse_bind( MouseBind* bind )
+{
+	MouseBindIndex* index;
+
+	index = input_get_mouse_index( &context->layers[bind->layer], bind->type );
+
+	input_mouseindex_remove( index, bind );
+	list_remove( index->binds, &bind->node );
+	input_pool_free( &context->mousebind_pool, bind );
+}
+
+void input_remove_mouse_bind( MouseBind* bind )
+{
+	if ( !context->initialized ) return;
+	if ( bind == NULL ) return;
+
+	if ( !input_can_modify() )
+	{
+		input_remove_bind_later( input_get_mouse_bind_handle( bind ) );
+		return;
+	}
+
+	input_apply_ops();
+	input_unlink_mouse_bind( bind );
+}
+
+input_bind_t input_get_key_bind_handle( KeyBind* bind )
+{
+	if ( bind == NULL ) return INPUT_INVALID_BIND;
+	return BIND_HANDLE_KEY | input_pool_handle( bind );
+}
+
+input_bind_t input_get_mouse_bind_handle( MouseBind* bind )
+{
+	if ( bind == NULL ) return INPUT_INVALID_BIND;
+	return BIND_HANDLE_MOUSE | input_pool_handle( bind );
+}
+
+KeyBind* input_get_key_bind( input_bind_t handle )
+{
+	if ( !context->initialized ) return NULL;
+	if ( ( handle & BIND_HANDLE_TYPE_MASK ) != BIND_HANDLE_KEY ) return NULL;
+
+	return input_pool_lookup( &context->keybind_pool, handle );
+}
+
+MouseBind* input_get_mouse_bind( input_bind_t handle )
+{
+	if ( !context->initialized ) return NULL;
+	if ( ( handle & BIND_HANDLE_TYPE_MASK ) != BIND_HANDLE_MOUSE ) return NULL;
+
+	return input_pool_lookup( &context->mousebind_pool, handle );
+}
+
+bool input_is_bind_valid( input_bind_t handle )
+{
+	return input_get_key_bind( handle ) != NULL || input_get_mouse_bind( handle ) != NULL;
+}
+
+static bool input_unlink_bind( input_bind_t handle )
+{
+	KeyBind* key_bind;
+	MouseBind* mouse_bind;
+
+	if ( ( key_bind = input_get_key_bind( handle ) ) != NULL )
+	{
+		input_unlink_key_bind( key_bind );
+		return true;
+	}
+
+	if ( ( mouse_bind = input_get_mouse_bind( handle ) ) != NULL )
+	{
+		input_unlink_mouse_bind( mouse_bind );
+		return true;
+	}
+
+	return false;
+}
+
+bool input_remove_bind( input_bind_t handle )
+{
+	if ( !context->initialized ) return false;
+
+	if ( !input_can_modify() )
+	{
+		// The handle is checked right away, the bind is removed by the input thread
+		if ( !input_is_bind_valid( handle ) ) return false;
+
+		input_remove_bind_later( handle );
+		return true;
+	}
+
+	input_apply_ops();
+	return input_unlink_bind( handle );
+}
+
+static bool input_apply_bind_change( const InputOp* op )
+{
+	KeyBind* key_bind;
+	MouseBind* mouse_bind;
+	MouseBindIndex* index;
+
+	// Changes posted for binds removed in the meantime are dropped by the handle check
+	key_bind = input_get_key_bind( op->change.handle );
+	mouse_bind = input_get_mouse_bind( op->change.handle );
+
+	switch ( op->type )
+	{
+	case OP_ENABLE_BIND:
+		if ( key_bind ) key_bind->disabled = !op->change.enable;
+		else if ( mouse_bind ) mouse_bind->disabled = !op->change.enable;
+		else return false;
+		return true;
+
+	case OP_SET_BIND_PARAM:
+		if ( key_bind ) key_bind->userdata = op->change.data;
+		else if ( mouse_bind ) mouse_bind->userdata = op->change.data;
+		else return false;
+		return true;
+
+	case OP_SET_BIND_RECT:
+		if ( mouse_bind == NULL ) return false;
+
+		index = input_get_mouse_index( &context->layers[mouse_bind->layer], mouse_bind->type );
+
+		input_mouseindex_remove( index, mouse_bind );
+		mouse_bind->bounds = op->change.rect;
+		input_mouseindex_insert( index, mouse_bind );
+		return true;
+
+	case OP_SET_BIND_BUTTON:
+		if ( mouse_bind == NULL ) return false;
+		mouse_bind->button = op->change.button;
+		return true;
+
+	case OP_SET_BIND_FUNC:
+		if ( mouse_bind == NULL ) return false;
+		mouse_bind->handler = op->change.func;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static bool input_change_bind( const InputOp* change )
+{
+	InputOp* op;
+	bool valid;
+
+	if ( !context->initialized ) return false;
+
+	if ( input_can_modify() )
+	{
+		// A bind registered by another thread is only in the index once its link op is applied
+		input_apply_ops();
+		return input_apply_bind_change( change );
+	}
+
+	// The handle is checked right away, the bind is changed by the input thread
+	if ( change->type == OP_ENABLE_BIND || change->type == OP_SET_BIND_PARAM )
+		valid = input_is_bind_valid( change->change.handle );
+	else
+		valid = input_get_mouse_bind( change->change.handle ) != NULL;
+
+	if ( !valid ) return false;
+	if ( ( op = input_create_op( change->type ) ) == NULL ) return false;
+
+	op->change = change->change;
+	input_post_op( op );
+
+	return true;
+}
+
+static void input_apply_ops( void )
+{
+	InputOp *op, *next;
+
+	if ( !input_is_input_thread() || context->dispatch_depth ) return;
+	if ( context->deferred_ops == NULL && input_atomic_load_ptr( &context->pending_ops ) == NULL ) return;
+
+	for ( op = input_take_ops(); op != NULL; op = next )
+	{
+		next = op->next;
+
+		switch ( op->type )
+		{
+		case OP_LINK_HOOK:
+			input_link_hook( op->hook.hook, op->hook.event );
+			break;
+
+		case OP_REMOVE_HOOK:
+			input_unlink_hook( op->hook.event, op->hook.handler );
+			break;
+
+		case OP_LINK_KEY_BIND:
+			input_link_key_bind( op->key_bind );
+			break;
+
+		case OP_LINK_MOUSE_BIND:
+			input_link_mouse_bind( op->mouse_bind );
+			break;
+
+		case OP_REMOVE_KEY_BINDS:
+			input_unlink_key_binds( op->keys.key, op->keys.modifiers, op->keys.func, op->keys.type );
+			break;
+
+		case OP_REMOVE_SEQUENCE_BINDS:
+			input_unlink_sequence_binds( op->sequence.keys, op->sequence.count, op->sequence.func );
+			break;
+
+		case OP_REMOVE_MOUSE_BINDS:
+			input_unlink_mouse_binds( op->mouse.button, op->mouse.func, op->mouse.type );
+			break;
+
+		case OP_REMOVE_BIND:
+			input_unlink_bind( op->handle );
+			break;
+
+		case OP_ENABLE_BIND:
+		case OP_SET_BIND_PARAM:
+		case OP_SET_BIND_RECT:
+		case OP_SET_BIND_BUTTON:
+		case OP_SET_BIND_FUNC:
+			input_apply_bind_change( op );
+			break;
+		}
+
+		mem_free( op );
+	}
+}
+
+bool input_enable_bind( input_bind_t handle, bool enable )
+{
+	InputOp change;
+
+	change.type = OP_ENABLE_BIND;
+	change.change.handle = handle;
+	change.change.enable = enable;
+
+	return input_change_bind( &change );
+}
+
+bool input_set_bind_param( input_bind_t handle, void* data )
+{
+	InputOp change;
+
+	change.type = OP_SET_BIND_PARAM;
+	change.change.handle = handle;
+	change.change.data = data;
+
+	return input_change_bind( &change );
+}
+
+bool input_set_bind_rect( input_bind_t handle, rectangle_t* area )
+{
+	InputOp change;
+
+	if ( area == NULL ) return false;
+
+	change.type = OP_SET_BIND_RECT;
+	change.change.handle = handle;
+	change.change.rect = *area;
+
+	return input_change_bind( &change );
+}
+
+void input_set_mousebind_button( MouseBind* bind, MOUSEBTN button )
+{
+	InputOp change;
+
+	if ( bind == NULL ) return;
+
+	change.type = OP_SET_BIND_BUTTON;
+	change.change.handle = input_get_mouse_bind_handle( bind );
+	change.change.button = button;
+
+	input_change_bind( &change );
+}
+
+void input_set_mousebind_rect( MouseBind* bind, rectangle_t* area )
+{
+	if ( bind == NULL ) return;
+	input_set_bind_rect( input_get_mouse_bind_handle( bind ), area );
+}
+
+void input_set_mousebind_func( MouseBind* bind, mousebind_func_t func )
+{
+	InputOp change;
+
+	if ( bind == NULL ) return;
+
+	change.type = OP_SET_BIND_FUNC;
+	change.change.handle = input_get_mouse_bind_handle( bind );
+	change.change.func = func;
+
+	input_change_bind( &change );
+}
+
+void input_set_mousebind_param( MouseBind* bind, void* data )
+{
+	if ( bind == NULL ) return;
+	input_set_bind_param( input_get_mouse_bind_handle( bind ), data );
+}
+
+input_layer_t input_create_layer( const char* name, uint32 flags )
+{
+	uint32 i;
+
+	if ( !context->initialized ) return INPUT_INVALID_LAYER;
+	if ( name == NULL ) return INPUT_INVALID_LAYER;
+
+	// Layer names are unique, creating an existing layer returns the old one
+	if ( ( i = input_find_layer( name ) ) != INPUT_INVALID_LAYER ) return i;
+
+	for ( i = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( !context->layers[i].created )
+		{
+			input_layer_create( &context->layers[i], name, flags );
+			return i;
 		}
 	}
 
-	return ret;
+	return INPUT_INVALID_LAYER;
+}
+
+input_layer_t input_find_layer( const char* name )
+{
+	uint32 i;
+
+	if ( name == NULL ) return INPUT_INVALID_LAYER;
+
+	for ( i = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( context->layers[i].created && strncmp( context->layers[i].name, name, sizeof(context->layers[i].name) - 1 ) == 0 )
+			return i;
+	}
+
+	return INPUT_INVALID_LAYER;
+}
+
+bool input_push_layer( input_layer_t layer )
+{
+	if ( layer >= INPUT_MAX_LAYERS || !context->layers[layer].created ) return false;
+
+	// A layer can only be on the stack once
+	if ( context->layers[layer].stacked ) return false;
+
+	context->layer_stack[context->layer_stack_size++] = (uint8)layer;
+	context->layers[layer].stacked = true;
+
+	return true;
+}
+
+input_layer_t input_pop_layer( void )
+{
+	input_layer_t layer;
+
+	// The default layer can not be popped
+	if ( context->layer_stack_size <= 1 ) return INPUT_INVALID_LAYER;
+
+	layer = context->layer_stack[--context->layer_stack_size];
+	context->layers[layer].stacked = false;
+
+	return layer;
+}
+
+bool input_enable_layer( input_layer_t layer, bool enable )
+{
+	if ( layer >= INPUT_MAX_LAYERS || !context->layers[layer].created ) return false;
+
+	context->layers[layer].enabled = enable;
+	return true;
+}
+
+bool input_is_layer_active( input_layer_t layer )
+{
+	if ( layer >= INPUT_MAX_LAYERS || !context->layers[layer].created ) return false;
+
+	return context->layers[layer].stacked && context->layers[layer].enabled;
+}
+
+input_layer_t input_set_bind_layer( input_layer_t layer )
+{
+	input_layer_t prev = context->bind_layer;
+
+	if ( layer >= INPUT_MAX_LAYERS || !context->layers[layer].created ) return INPUT_INVALID_LAYER;
+
+	context->bind_layer = layer;
+	return prev;
+}
+
+void input_set_modifiers( uint32 modifiers, bool set )
+{
+	if ( set ) context->modifier_state |= modifiers;
+	else context->modifier_state &= ~modifiers;
+
+	// Backends report the modifiers right before the key press itself
+	context->modifier_key_down = set && ( modifiers & ~INPUT_MOD_LOCKS ) != 0;
+}
+
+void input_set_lock_state( uint32 locks )
+{
+	context->modifier_state = ( context->modifier_state & ~INPUT_MOD_LOCKS ) | ( locks & INPUT_MOD_LOCKS );
+}
+
+uint32 input_get_modifiers( void )
+{
+	return context->modifier_state;
+}
+
+void input_set_event_time( uint64 time )
+{
+	context->capture_time = time;
+}
+
+uint64 input_get_event_time( void )
+{
+	return context->event_time;
+}
+
+uint64 input_get_time( void )
+{
+	return input_platform_get_time();
+}
+
+bool input_get_pool_stats( INPUT_POOL pool, InputPoolStats* stats )
+{
+	if ( stats == NULL ) return false;
+
+	switch ( pool )
+	{
+	case INPUT_POOL_KEYBINDS: input_pool_get_stats( &context->keybind_pool, stats ); return true;
+	case INPUT_POOL_MOUSEBINDS: input_pool_get_stats( &context->mousebind_pool, stats ); return true;
+	case INPUT_POOL_HOOKS: input_pool_get_stats( &context->hook_pool, stats ); return true;
+	default: return false;
+	}
+}
+
+#ifdef INPUT_PROFILE
+static void input_profile_insert( InputHandlerProfile* profiles, uint32* count, uint32 max, const InputHandlerProfile* entry )
+{
+	uint32 i;
+
+	// Keep the array sorted by the total time, the cheapest entry drops off when full
+	if ( *count == max && entry->total_time <= profiles[max-1].total_time ) return;
+
+	i = *count < max ? (*count)++ : max - 1;
+
+	for ( ; i > 0 && profiles[i-1].total_time < entry->total_time; i-- )
+		profiles[i] = profiles[i-1];
+
+	profiles[i] = *entry;
+}
+
+static void input_profile_fill( InputHandlerProfile* entry, INPUT_HANDLER_TYPE type, void* handler,
+								input_bind_t bind, INPUT_EVENT event, const HandlerProfile* profile )
+{
+	entry->type = type;
+	entry->handler = handler;
+	entry->bind = bind;
+	entry->event = event;
+	entry->calls = profile->calls;
+	entry->consumed = profile->consumed;
+	entry->total_time = profile->total_time;
+	entry->max_time = profile->max_time;
+}
+
+#endif
+
+uint32 input_get_handler_profile( InputHandlerProfile* profiles, uint32 max )
+{
+#ifdef INPUT_PROFILE
+	InputHandlerProfile entry;
+	InputHookFunc* hook;
+	KeyBind* key;
+	MouseBind* mouse;
+	uint32 i, count = 0;
+
+	if ( !context->initialized || profiles == NULL || max == 0 ) return 0;
+
+	for ( i = 0; i < context->hook_pool.capacity; i++ )
+	{
+		hook = input_pool_at( &context->hook_pool, i );
+		if ( hook == NULL || hook->profile.calls == 0 ) continue;
+
+		input_profile_fill( &entry, INPUT_HANDLER_HOOK, (void*)hook->handler, INPUT_INVALID_BIND, hook->event, &hook->profile );
+		input_profile_insert( profiles, &count, max, &entry );
+	}
+
+	for ( i = 0; i < context->keybind_pool.capacity; i++ )
+	{
+		key = input_pool_at( &context->keybind_pool, i );
+		if ( key == NULL || key->profile.calls == 0 ) continue;
+
+		input_profile_fill( &entry, INPUT_HANDLER_KEYBIND, (void*)key->handler, input_get_key_bind_handle( key ),
+							input_key_bind_event( key ), &key->profile );
+		input_profile_insert( profiles, &count, max, &entry );
+	}
+
+	for ( i = 0; i < context->mousebind_pool.capacity; i++ )
+	{
+		mouse = input_pool_at( &context->mousebind_pool, i );
+		if ( mouse == NULL || mouse->profile.calls == 0 ) continue;
+
+		input_profile_fill( &entry, INPUT_HANDLER_MOUSEBIND, (void*)mouse->handler, input_get_mouse_bind_handle( mouse ),
+							input_mouse_bind_event( mouse ), &mouse->profile );
+		input_profile_insert( profiles, &count, max, &entry );
+	}
+
+	return count;
+#else
+	UNREFERENCED_PARAM( profiles );
+	UNREFERENCED_PARAM( max );
+	return 0;
+#endif
 }
 
-bool input_handle_mouse_move_bind( int16 x, int16 y )
+void input_reset_handler_profile( void )
 {
-	MouseBind* bind;
+#ifdef INPUT_PROFILE
+	InputHookFunc* hook;
+	KeyBind* key;
+	MouseBind* mouse;
+	uint32 i;
+
+	for ( i = 0; i < context->hook_pool.capacity; i++ )
+	{
+		if ( ( hook = input_pool_at( &context->hook_pool, i ) ) != NULL )
+			memset( &hook->profile, 0, sizeof(hook->profile) );
+	}
+
+	for ( i = 0; i < context->keybind_pool.capacity; i++ )
+	{
+		if ( ( key = input_pool_at( &context->keybind_pool, i ) ) != NULL )
+			memset( &key->profile, 0, sizeof(key->profile) );
+	}
+
+	for ( i = 0; i < context->mousebind_pool.capacity; i++ )
+	{
+		if ( ( mouse = input_pool_at( &context->mousebind_pool, i ) ) != NULL )
+			memset( &mouse->profile, 0, sizeof(mouse->profile) );
+	}
+#endif
+}
+
+void input_block_keys( bool block )
+{
+	context->block_keys = block;
+}
+
+bool input_is_cursor_showing( void )
+{
+	return context->shared.show_cursor;
+}
+
+void input_get_cursor_pos( int16* x, int16* y )
+{
+	*x = context->shared.mouse_x;
+	*y = context->shared.mouse_y;
+}
+
+bool input_set_relative_mouse( bool enable )
+{
+	if ( !context->initialized ) return false;
+	if ( enable == context->relative_mouse ) return true;
+
+	if ( !input_platform_set_relative_mouse( enable ) ) return false;
+
+	context->relative_mouse = enable;
+	return true;
+}
+
+bool input_is_relative_mouse( void )
+{
+	return context->relative_mouse;
+}
+
+static bool input_handle_hooks( InputEvent* event )
+{
+	list_t* list;
+	node_t* node;
+	InputHookFunc* hook;
+
+	list = context->input_hooks[event->type];
+
+	if ( list_empty(list) ) return true;
+
+	list_foreach( list, node )
+	{
+		hook = (InputHookFunc*)node;
+
+		if ( !input_call_hook( hook, event ) )
+			return false;
+	}
+
+	if ( context->block_keys && event->type <= INPUT_KEY_DOWN )
+		return false;
+
+	return true;
+}
+
+static bool input_handle_char_bind( uint32 key )
+{
+	KeyBind* bind;
+	InputLayer* layer;
 	node_t *node, *tmp;
+	uint32 i;
 	bool ret = true;
 
-	if ( !input_initialized ) return true;
+	if ( !context->initialized ) return true;
 
-	list_foreach_safe( mouse_move_binds, node, tmp )
+	for ( i = context->layer_stack_size; i--; )
 	{
-		bind = (MouseBind*)node;
+		if ( i >= context->layer_stack_size ) continue;
 
-		if ( rect_is_point_in( &bind->bounds, x, y ) )
+		layer = &context->layers[context->layer_stack[i]];
+		if ( !layer->enabled ) continue;
+
+		list_foreach_safe( layer->char_binds, node, tmp )
 		{
-			if ( !bind->handler( MOUSE_NONE, x, y, bind->userdata ) )
+			bind = (KeyBind*)node;
+			if ( bind->disabled ) continue;
+			if ( !input_call_key_handler( bind, key ) )
 			{
 				ret = false;
 			}
 		}
+
+		// An event consumed by a layer is not passed to the layers below it
+		if ( !ret || ( layer->flags & INPUT_LAYER_OPAQUE ) ) break;
 	}
 
 	return ret;
 }
 
-bool input_handle_mouse_up_bind( MOUSEBTN button, int16 x, int16 y )
+static bool input_dispatch_key_bind( BINDTYPE_KB type, uint32 key )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	InputLayer* layer;
+	uint32 i, chord;
+
+	if ( !context->initialized ) return true;
+
+	chord = input_chord_modifiers( context->event_modifiers );
+
+	for ( i = context->layer_stack_size; i--; )
+	{
+		// Handlers may pop layers while the stack is being walked
+		if ( i >= context->layer_stack_size ) continue;
+
+		layer = &context->layers[context->layer_stack[i]];
+		if ( !layer->enabled ) continue;
+
+		// The chord matching the held modifiers is dispatched first, only a single
+		// slot of the chord table can match so this is a constant time lookup.
+		if ( type == BIND_KEYDOWN && !input_keytable_dispatch( &layer->chord_binds, key, chord ) ) return false;
+
+		if ( !input_keytable_dispatch( input_get_key_table( layer, type ), key, 0 ) ) return false;
+		if ( layer->flags & INPUT_LAYER_OPAQUE ) break;
+	}
+
+	return true;
+}
+
+static bool input_dispatch_mouse_bind( BINDTYPE_MOUSE type, MOUSEBTN button, int16 x, int16 y )
+{
+	InputLayer* layer;
+	uint32 i;
+
+	if ( !context->initialized ) return true;
+
+	for ( i = context->layer_stack_size; i--; )
+	{
+		if ( i >= context->layer_stack_size ) continue;
+
+		layer = &context->layers[context->layer_stack[i]];
+		if ( !layer->enabled ) continue;
+
+		if ( !input_mouseindex_dispatch( input_get_mouse_index( layer, type ), button, x, y ) ) return false;
+		if ( layer->flags & INPUT_LAYER_OPAQUE ) break;
+	}
+
+	return true;
+}
+
+static bool input_build_sequences( void )
+{
+	InputSequencePattern* patterns;
+	KeyBind* bind;
+	node_t* node;
+	uint32 i, count;
+	bool ret;
+
+	context->sequences_dirty = false;
+
+	for ( i = 0, count = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( !context->layers[i].created ) continue;
+
+		list_foreach( context->layers[i].sequence_binds, node )
+			count++;
+	}
+
+	if ( count == 0 ) return input_automaton_build( &context->sequence_fsm, NULL, 0 );
+
+	patterns = mem_alloc( count * sizeof(*patterns) );
+	if ( patterns == NULL ) return false;
+
+	// Automaton outputs refer to the binds by handle, so a handler removing a bind
+	// while the outputs are being walked is harmless
+	for ( i = 0, count = 0; i < INPUT_MAX_LAYERS; i++ )
+	{
+		if ( !context->layers[i].created ) continue;
+
+		list_foreach( context->layers[i].sequence_binds, node )
+		{
+			bind = (KeyBind*)node;
+
+			patterns[count].keys = bind->sequence->keys;
+			patterns[count].length = bind->sequence->length;
+			patterns[count].id = input_get_key_bind_handle( bind );
+			count++;
+		}
+	}
+
+	ret = input_automaton_build( &context->sequence_fsm, patterns, count );
+	mem_free( patterns );
+
+	return ret;
+}
+
+static bool input_dispatch_sequence_bind( uint32 key )
+{
+	KeyBind* bind;
+	InputLayer* layer;
+	uint32 i, state, match, output;
+	bool fired = false, ret = true;
+
+	if ( !context->initialized ) return true;
+
+	// Modifier keys are part of the key strokes, they never advance the sequences alone
+	if ( context->event_modifier_key ) return true;
+
+	if ( context->sequences_dirty ) input_build_sequences();
+	if ( context->sequence_fsm.num_states == 0 ) return true;
 
-	if ( !input_initialized ) return true;
+	state = input_automaton_step( &context->sequence_fsm, key, input_chord_modifiers( context->event_modifiers ), (uint32)( context->event_time / 1000000 ) );
 
-	list_foreach_safe( mouse_up_binds, node, tmp )
+	if ( context->sequence_fsm.dict[state] == INPUT_SEQUENCE_NONE && context->sequence_fsm.output[state] == INPUT_SEQUENCE_NONE )
+		return true;
+
+	// Every sequence ending at this key is reachable through the dictionary links,
+	// from the longest to the shortest. Layers are walked as with other binds.
+	for ( i = context->layer_stack_size; i--; )
 	{
-		bind = (MouseBind*)node;
+		if ( i >= context->layer_stack_size ) continue;
+
+		layer = &context->layers[context->layer_stack[i]];
+		if ( !layer->enabled ) continue;
 
-		if ( bind->button == button && rect_is_point_in( &bind->bounds, x, y ) )
+		for ( match = state; match != INPUT_SEQUENCE_NONE; match = context->sequence_fsm.dict[match] )
 		{
-			if ( !bind->handler( button, x, y, bind->userdata ) )
+			for ( output = context->sequence_fsm.output[match]; output != INPUT_SEQUENCE_NONE; output = context->sequence_fsm.out_next[output] )
 			{
-				ret = false;
+				bind = input_get_key_bind( context->sequence_fsm.out_id[output] );
+
+				if ( bind == NULL || bind->disabled ) continue;
+				if ( bind->layer != context->layer_stack[i] ) continue;
+				if ( !input_automaton_in_time( &context->sequence_fsm, bind->sequence->length, bind->sequence->timeout ) ) continue;
+
+				fired = true;
+
+				if ( !input_call_key_handler( bind, key ) )
+				{
+					ret = false;
+				}
 			}
 		}
+
+		if ( !ret || ( layer->flags & INPUT_LAYER_OPAQUE ) ) break;
 	}
 
+	// Matched keys do not start another sequence ("G G G" triggers "G G" only once)
+	if ( fired && !context->sequences_dirty ) context->sequence_fsm.state = INPUT_SEQUENCE_ROOT;
+
 	return ret;
 }
 
-bool input_handle_mouse_down_bind( MOUSEBTN button, int16 x, int16 y )
+void input_reset_sequences( void )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
+	context->sequence_fsm.state = INPUT_SEQUENCE_ROOT;
+}
+
+static bool input_handle_key_down_bind( uint32 key )
+{
+	// Sequences see every key press, even ones consumed by the key binds
+	if ( !input_dispatch_sequence_bind( key ) ) return false;
+
+	return input_dispatch_key_bind( BIND_KEYDOWN, key );
+}
+
+static bool input_handle_key_up_bind( uint32 key )
+{
+	return input_dispatch_key_bind( BIND_KEYUP, key );
+}
+
+static bool input_handle_mouse_move_bind( int16 x, int16 y )
+{
+	return input_dispatch_mouse_bind( BIND_MOVE, MOUSE_NONE, x, y );
+}
+
+static bool input_handle_mouse_up_bind( MOUSEBTN button, int16 x, int16 y )
+{
+	return input_dispatch_mouse_bind( BIND_BTNUP, button, x, y );
+}
+
+static bool input_handle_mouse_down_bind( MOUSEBTN button, int16 x, int16 y )
+{
+	return input_dispatch_mouse_bind( BIND_BTNDOWN, button, x, y );
+}
+
+static bool input_call_handlers( const InputEventRecord* record )
+{
+	InputEvent event;
 	bool ret = true;
 
-	if ( !input_initialized ) return true;
+	event = record->event;
+
+	// Binds see the time and modifiers of the event being dispatched, not the current ones
+	context->event_time = event.time;
+	context->event_modifiers = record->modifiers;
+	context->event_modifier_key = record->modifier_key;
 
-	list_foreach_safe( mouse_down_binds, node, tmp )
+	switch ( event.type )
 	{
-		bind = (MouseBind*)node;
+	case INPUT_CHARACTER:
+		// The character produced by a consumed key press is consumed as well
+		if ( context->key_consumed )
+		{
+			ret = false;
+			break;
+		}
+
+		ret = input_handle_hooks( &event ) && input_handle_char_bind( event.keyboard.key );
+		break;
+
+	case INPUT_KEY_DOWN:
+		ret = input_handle_hooks( &event ) && input_handle_key_down_bind( event.keyboard.key );
+		context->key_consumed = !ret;
+		return ret;
+
+	case INPUT_KEY_UP:
+		ret = input_handle_hooks( &event ) && input_handle_key_up_bind( event.keyboard.key );
+		break;
 
-		if ( bind->button == button && rect_is_point_in( &bind->bounds, x, y ) )
+	default:
+		ret = input_handle_hooks( &event );
+		if ( !ret ) break;
+
+		switch ( event.type )
 		{
-			if ( !bind->handler( button, x, y, bind->userdata ) )
-			{
-				ret = false;
-			}
+		case INPUT_MOUSE_MOVE:
+			ret = input_handle_mouse_move_bind( event.mouse.x, event.mouse.y );
+			break;
+
+		case INPUT_LBUTTON_DOWN:
+		case INPUT_MBUTTON_DOWN:
+		case INPUT_RBUTTON_DOWN:
+			ret = input_handle_mouse_down_bind( (MOUSEBTN)event.mouse.button, event.mouse.x, event.mouse.y );
+			break;
+
+		case INPUT_LBUTTON_UP:
+		case INPUT_MBUTTON_UP:
+		case INPUT_RBUTTON_UP:
+			ret = input_handle_mouse_up_bind( (MOUSEBTN)event.mouse.button, event.mouse.x, event.mouse.y );
+			break;
+
+		default:
+			break;
 		}
 	}
 
+	context->key_consumed = false;
+	return ret;
+}
+
+static bool input_dispatch_event( const InputEventRecord* record )
+{
+	uint64 start, end;
+	bool ret;
+
+	// Binds registered by other threads since the previous event take effect now
+	input_apply_ops();
+
+	context->dispatch_depth++;
+
+	if ( !input_latency_is_enabled() && !input_timeline_is_enabled() )
+	{
+		ret = input_call_handlers( record );
+	}
+	else
+	{
+		start = input_platform_get_time();
+		ret = input_call_handlers( record );
+		end = input_platform_get_time();
+
+		if ( input_latency_is_enabled() ) input_latency_record( record->event.type, record->event.time, start, end );
+		if ( input_timeline_is_enabled() ) input_timeline_event( &record->event, start, end, !ret );
+	}
+
+	// Hooks and binds added or removed by the handlers take effect once the outermost
+	// dispatch is over
+	context->dispatch_depth--;
+	input_apply_ops();
+
 	return ret;
 }
+
+bool input_dispatch_record( const InputEventRecord* record )
+{
+	InputEventRecord mouse;
+
+	if ( !context->initialized ) return true;
+	if ( record->event.type >= NUM_INPUT_EVENTS ) return true;
+
+	// Coalesced motion has to be dispatched before any other event to keep the order
+	if ( context->motion_pending && record->event.type != context->motion.event.type ) input_flush_motion();
+
+	if ( record->event.type < INPUT_MOUSE_MOVE ) return input_dispatch_event( record );
+
+	mouse = *record;
+
+	if ( mouse.event.type == INPUT_MOUSE_RELATIVE )
+	{
+		// Relative motion carries its own deltas and does not move the cursor
+		if ( !context->coalesce_motion ) return input_dispatch_event( &mouse );
+
+		if ( context->motion_pending )
+		{
+			mouse.event.relative.dx += context->motion.event.relative.dx;
+			mouse.event.relative.dy += context->motion.event.relative.dy;
+		}
+
+		context->motion = mouse;
+		context->motion_pending = true;
+
+		return true;
+	}
+
+	mouse.event.mouse.dx = mouse.event.mouse.x - context->shared.mouse_x;
+	mouse.event.mouse.dy = mouse.event.mouse.y - context->shared.mouse_y;
+
+	context->shared.mouse_x = mouse.event.mouse.x;
+	context->shared.mouse_y = mouse.event.mouse.y;
+
+	if ( mouse.event.type != INPUT_MOUSE_MOVE || !context->coalesce_motion ) return input_dispatch_event( &mouse );
+
+	// Merge the motion into the pending event, which keeps the last position and
+	// the sum of the deltas until the end of the frame
+	if ( context->motion_pending )
+	{
+		mouse.event.mouse.dx += context->motion.event.mouse.dx;
+		mouse.event.mouse.dy += context->motion.event.mouse.dy;
+	}
+
+	context->motion = mouse;
+	context->motion_pending = true;
+
+	return true;
+}
+
+void input_coalesce_motion( bool enable )
+{
+	if ( !enable ) input_flush_motion();
+	context->coalesce_motion = enable;
+}
+
+void input_flush_motion( void )
+{
+	if ( !context->motion_pending ) return;
+
+	context->motion_pending = false;
+	input_dispatch_event( &context->motion );
+}
+
+bool input_submit_record( const InputEventRecord* record )
+{
+	if ( !context->initialized ) return true;
+
+	// The frame snapshot follows the input as it is captured, not as it is dispatched
+	if ( record->event.type == INPUT_MOUSE_RELATIVE )
+	{
+		input_state_relative_event( record->event.relative.dx, record->event.relative.dy );
+	}
+	else if ( record->event.type >= INPUT_MOUSE_MOVE )
+	{
+		input_state_mouse_event( record->event.type, record->event.mouse.x, record->event.mouse.y,
+								 (MOUSEBTN)record->event.mouse.button, (MOUSEWHEEL)record->event.mouse.wheel );
+	}
+
+	// In queued mode the event is handled later, it can't be consumed here
+	if ( input_queue_is_enabled() )
+	{
+		input_queue_post( record );
+		return true;
+	}
+
+	return input_dispatch_record( record );
+}
+
+static bool input_post_record( InputEventRecord* record )
+{
+	if ( !context->initialized ) return true;
+
+	record->event.time = context->capture_time;
+	record->modifiers = context->modifier_state;
+	record->modifier_key = context->modifier_key_down;
+
+	if ( input_is_recording() && input_is_default_context() ) input_trace_write( record );
+
+	return input_submit_record( record );
+}
+
+bool input_post_key_event( INPUT_EVENT type, uint32 key )
+{
+	InputEventRecord record;
+
+	memset( &record, 0, sizeof(record) );
+
+	record.event.type = type;
+	record.event.keyboard.key = key;
+
+	return input_post_record( &record );
+}
+
+bool input_post_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	InputEventRecord record;
+
+	memset( &record, 0, sizeof(record) );
+
+	record.event.type = type;
+	record.event.mouse.x = x;
+	record.event.mouse.y = y;
+	record.event.mouse.button = (uint8)button;
+	record.event.mouse.wheel = (uint8)wheel;
+
+	return input_post_record( &record );
+}
+
+bool input_handle_keyboard_event( INPUT_EVENT type, uint32 key )
+{
+	return input_post_key_event( type, key );
+}
+
+bool input_handle_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	return input_post_mouse_event( type, x, y, button, wheel );
+}
+
+bool input_post_relative_event( float dx, float dy )
+{
+	InputEventRecord record;
+
+	memset( &record, 0, sizeof(record) );
+
+	record.event.type = INPUT_MOUSE_RELATIVE;
+	record.event.relative.dx = dx;
+	record.event.relative.dy = dy;
+
+	return input_post_record( &record );
+}
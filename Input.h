@@ -34,6 +34,7 @@ typedef enum {
 	INPUT_MBUTTON_DOWN,		// Middle mouse button pressed
 	INPUT_RBUTTON_UP,		// Right mouse button released
 	INPUT_RBUTTON_DOWN,		// Right mouse button pressed
+	INPUT_MOUSE_RELATIVE,	// Raw mouse movement in relative mode
 	NUM_INPUT_EVENTS
 } INPUT_EVENT;
 
@@ -65,11 +66,18 @@ typedef enum {
  * Passed to an input hook function when a event that is hooked is triggered.
  * If the event is a keyboard event, 'keyboard' field of the struct is used,
  * similarly the 'mouse' field is used when a mouse event is triggered.
+ *
+ * The time of the event is in nanoseconds on the same monotonic clock as
+ * input_get_time. Event times reported by the window system are converted
+ * to this clock, so events from different sources can be compared.
  */
 typedef struct {
 	/* Type of the event is always returned first. */
 	INPUT_EVENT type;
 
+	/* Time the event was generated at, in nanoseconds. */
+	uint64 time;
+
 	union {
 		/* Mouse info, returned when a mouse event is triggered. */
 		struct {
@@ -79,6 +87,11 @@ typedef struct {
 			uint8 wheel;	/* Mouse wheel movement (see MOUSEWHEEL above). */
 		} mouse;
 
+		/* Raw mouse movement, returned by relative mode mouse events. */
+		struct {
+			float dx, dy;	/* Unaccelerated movement in device units. */
+		} relative;
+
 		/* Keyboard info returns the key that triggered a keybord event. */
 		struct {
 			uint32 key;		/* Pressed key or injected chracter. */
@@ -86,12 +99,326 @@ typedef struct {
 	};
 } InputEvent;
 
+/**
+ * Modifier keys.
+ *
+ * The state of the modifier and lock keys is tracked as a single bitmask,
+ * returned by input_get_modifiers. Chord binds match on the generic masks
+ * (INPUT_MOD_SHIFT etc.), so either side of a modifier triggers the chord
+ * and the state of the lock keys is ignored.
+ */
+#define INPUT_MOD_LSHIFT		0x0001
+#define INPUT_MOD_RSHIFT		0x0002
+#define INPUT_MOD_LCONTROL		0x0004
+#define INPUT_MOD_RCONTROL		0x0008
+#define INPUT_MOD_LALT			0x0010
+#define INPUT_MOD_RALT			0x0020
+#define INPUT_MOD_LSUPER		0x0040
+#define INPUT_MOD_RSUPER		0x0080
+#define INPUT_MOD_CAPSLOCK		0x0100
+#define INPUT_MOD_NUMLOCK		0x0200
+#define INPUT_MOD_SCROLLLOCK	0x0400
+
+#define INPUT_MOD_SHIFT			( INPUT_MOD_LSHIFT | INPUT_MOD_RSHIFT )
+#define INPUT_MOD_CONTROL		( INPUT_MOD_LCONTROL | INPUT_MOD_RCONTROL )
+#define INPUT_MOD_ALT			( INPUT_MOD_LALT | INPUT_MOD_RALT )
+#define INPUT_MOD_SUPER			( INPUT_MOD_LSUPER | INPUT_MOD_RSUPER )
+#define INPUT_MOD_LOCKS			( INPUT_MOD_CAPSLOCK | INPUT_MOD_NUMLOCK | INPUT_MOD_SCROLLLOCK )
+
+/**
+ * Key sequences, e.g. "G G" or "Ctrl+K Ctrl+C". Modifier keys pressed alone are ignored,
+ * the timeout is the longest gap in milliseconds between two keys (0 for none).
+ */
+#define INPUT_MAX_SEQUENCE_LENGTH	16
+
+typedef struct {
+	uint32 key;				/* Key code, same as with key down binds. */
+	uint32 modifiers;		/* Generic modifiers held with the key (INPUT_MOD_SHIFT etc). */
+} InputKeyStroke;
+
+/**
+ * Event queue.
+ *
+ * By default input_process passes events to hooks and binds right away, on the
+ * thread calling it. In queued mode input_process only stores the events in a
+ * lock-free ring buffer and returns, and the events are dispatched later with
+ * input_dispatch_pending. A single thread may call input_process and a single
+ * thread input_dispatch_pending. The queue should be enabled and disabled while
+ * neither is running. Since queued events are dispatched later, they are never
+ * consumed by input_process.
+ */
+typedef enum {
+	INPUT_QUEUE_DROP,		// Events which don't fit in a full queue are dropped
+	INPUT_QUEUE_COALESCE,	// Mouse motion is merged while the queue is full, other events are dropped
+} INPUT_QUEUE_POLICY;
+
+typedef struct {
+	uint32 capacity;		/* Number of events the queue can hold. */
+	uint32 queued;			/* Number of events waiting to be dispatched. */
+	uint32 peak;			/* Largest number of events waiting at once. */
+	uint32 posted;			/* Number of events posted to the queue. */
+	uint32 dropped;			/* Number of events dropped because the queue was full. */
+	uint32 coalesced;		/* Number of motion events merged because the queue was full. */
+} InputQueueStats;
+
+/**
+ * Motion coalescing.
+ *
+ * A high rate mouse may report motion thousands of times per second. When motion
+ * coalescing is enabled, consecutive motion events are merged into one which is
+ * dispatched at the end of the frame (input_flush_motion). The merged event has
+ * the last position and the sum of the deltas. Any other event dispatches the
+ * pending motion first, so motion is never reordered with buttons or keys. In
+ * queued mode input_dispatch_pending ends the frame as well.
+ */
+
+/**
+ * Frame snapshots.
+ *
+ * For applications polling the input state once per frame. input_begin_frame
+ * freezes the state of the keyboard and mouse along with everything that has
+ * changed since the previous call, and the input_is/was_* queries are simple
+ * bit tests on that snapshot. The snapshot only changes in input_begin_frame,
+ * so reads between two frames are always consistent. A key pressed and released
+ * within the same frame shows up as both pressed and released.
+ *
+ * Key bitmaps are indexed by platform key codes, use the query functions to test
+ * for a key. Mouse buttons are stored as bits (1 << MOUSEBTN).
+ */
+#define INPUT_FRAME_KEY_WORDS	8
+
+typedef struct {
+	uint64 time;								/* Time the frame began at, see input_get_time. */
+	uint32 modifiers;							/* Held modifiers and active locks (INPUT_MOD_*). */
+	uint32 keys_down[INPUT_FRAME_KEY_WORDS];	/* Keys held down. */
+	uint32 keys_pressed[INPUT_FRAME_KEY_WORDS];	/* Keys pressed since the previous frame. */
+	uint32 keys_released[INPUT_FRAME_KEY_WORDS];/* Keys released since the previous frame. */
+	int16 x, y;									/* Mouse cursor position. */
+	int32 dx, dy;								/* Mouse movement since the previous frame. */
+	int32 wheel;								/* Wheel steps since the previous frame, up is positive. */
+	uint32 buttons;								/* Mouse buttons held down. */
+	uint32 buttons_pressed;						/* Mouse buttons pressed since the previous frame. */
+	uint32 buttons_released;					/* Mouse buttons released since the previous frame. */
+	float raw_dx, raw_dy;						/* Relative mode mouse movement since the previous frame. */
+} InputFrame;
+
+/**
+ * Relative mouse mode hides and confines the cursor and reports raw, unaccelerated
+ * motion to hooks as INPUT_MOUSE_RELATIVE. input_set_relative_mouse returns false if
+ * the mode is not supported (on X11 it requires XInput 2).
+ */
+
+/**
+ * Event injection.
+ *
+ * Synthetic events are posted through the same path as the events of the window
+ * system, so they are queued, coalesced, passed to hooks and binds and tracked in
+ * the frame snapshots in the same way. Injected key presses update the modifier
+ * state and the key bitmap. Buttons and wheel steps are injected at the position
+ * of the last injected motion. Events must be injected from the thread calling
+ * input_process. When the library is built with INPUT_HEADLESS, the headless
+ * backend is used instead of the window system: input_initialize accepts any
+ * non-NULL window and input_process takes an InputEvent.
+ */
+
+/**
+ * XCB backend.
+ *
+ * When the library is built with INPUT_XCB, X11 input is read through XCB instead
+ * of Xlib and input_initialize takes an InputXcbWindow. The backend never waits for
+ * the X server: requests with a reply are sent right away and their replies picked
+ * up by later calls to input_process. input_process takes an xcb_generic_event_t,
+ * or NULL to drain the events which have arrived on the connection in one batch.
+ * When draining, the events the library did not consume (including all events
+ * other than input events and the events of other windows) are passed to event_func
+ * before they are freed. Key events only update the key bitmap until the keyboard
+ * mapping has arrived, and relative mouse mode is not available.
+ */
+typedef void			( *input_event_func_t )			( void* event, void* data );
+
+typedef struct {
+	void* connection;				/* xcb_connection_t of the window. */
+	uint32 window;					/* xcb_window_t to read the input of. */
+	input_event_func_t event_func;	/* Called with the unconsumed events when draining, may be NULL. */
+	void* event_data;				/* User data passed to event_func. */
+} InputXcbWindow;
+
+/**
+ * evdev backend.
+ *
+ * When the library is built with INPUT_EVDEV, input is read straight from Linux
+ * event devices (/dev/input/event*) without a window system, and input_initialize
+ * takes an InputEvdevWindow. The descriptors are made non-blocking and stay owned
+ * by the application. Any stream of struct input_event works, such as a pipe
+ * replaying a recorded dump. input_process takes a pointer to one of the
+ * descriptors to read only that one (e.g. when poll reports it readable), or NULL
+ * to read all of them. Each read call fetches a batch of events.
+ *
+ * Keys are reported with the same keysyms as on X11 (see KeyDefs.h), using a US
+ * layout. Relative motion moves a pointer kept inside the screen, absolute axes
+ * (touchscreens, tablets) are scaled to the screen when the device reports their
+ * range. The left, right and middle buttons and touches are passed as mouse buttons.
+ * Touchpads are not supported. Event times are the kernel timestamps: event devices
+ * are switched to the monotonic clock, and the times of other streams are shifted
+ * so their first event happens when it is read. There is no cursor to show or hide.
+ */
+typedef struct {
+	const int* fds;					/* Descriptors of the event devices. */
+	uint32 count;					/* Number of descriptors. */
+	int16 width, height;			/* Size of the screen, 0 to leave the pointer unbounded. */
+} InputEvdevWindow;
+
+/**
+ * Input traces record captured and injected events to a file. input_replay submits
+ * them again as if they were captured now, and fails if the file is not a valid trace.
+ */
+typedef enum {
+	INPUT_REPLAY_REALTIME,	// Events are replayed with the delays they were recorded with
+	INPUT_REPLAY_FAST,		// Events are replayed as fast as possible
+} INPUT_REPLAY_MODE;
+
+/**
+ * Latency statistics.
+ *
+ * When enabled, two latencies are measured for every dispatched event: the delay
+ * from the time of the event (see InputEvent) to the start of its dispatch, which
+ * includes the time spent in the window system and the event queue, and the time
+ * spent dispatching the event to hooks and binds. Both are collected per event type
+ * into histograms with logarithmic buckets, the value of a bucket is within 1/16 of
+ * the values counted in it. Latencies are in nanoseconds. The histograms are updated
+ * by the thread dispatching the events and should be read by the same thread.
+ */
+#define INPUT_LATENCY_BUCKETS	528
+
+typedef struct {
+	uint64 count;							/* Number of measured events. */
+	uint64 min, max;						/* Smallest and largest latency. */
+	uint64 total;							/* Sum of all latencies, for the mean. */
+	uint64 p50, p90, p99, p999;				/* Percentiles, rounded up to the bucket edge. */
+	uint32 buckets[INPUT_LATENCY_BUCKETS];	/* Event counts, see input_get_latency_bucket_value. */
+} InputLatencyHistogram;
+
+typedef struct {
+	InputLatencyHistogram delay;			/* From the event time to the start of the dispatch. */
+	InputLatencyHistogram dispatch;			/* Time spent in the hooks and binds. */
+} InputLatencyStats;
+
+/**
+ * Dispatch timeline, a ring of the given number of slices for dispatched events and the
+ * handlers called for them. input_write_timeline writes and clears it.
+ */
+typedef enum {
+	INPUT_TIMELINE_JSON,		// Chrome trace event JSON
+	INPUT_TIMELINE_PERFETTO,	// Perfetto protobuf trace
+} INPUT_TIMELINE_FORMAT;
+
+/**
+ * Bind layers.
+ *
+ * Every bind belongs to a layer. Layers are activated by pushing them onto the
+ * layer stack and binds are dispatched from the topmost active layer down. An
+ * event consumed by a bind is not passed to the layers below. Pushing, popping,
+ * enabling and disabling a layer are O(1) operations which do not allocate.
+ * The default layer always exists and sits at the bottom of the stack.
+ */
+typedef uint32 input_layer_t;
+
+#define INPUT_MAX_LAYERS		32
+#define INPUT_LAYER_NAME_LEN	32
+#define INPUT_DEFAULT_LAYER		0
+#define INPUT_INVALID_LAYER		( (input_layer_t)-1 )
+
+#define INPUT_LAYER_OPAQUE		0x1		/* Layers below this one never see any events (e.g. modal dialogs). */
+
+/**
+ * Object pools.
+ *
+ * Binds and hooks are allocated from fixed size pools owned by the library.
+ * Pool occupancy can be queried with input_get_pool_stats.
+ */
+typedef enum {
+	INPUT_POOL_KEYBINDS,	// Character, key up and key down binds
+	INPUT_POOL_MOUSEBINDS,	// Mouse move and button binds
+	INPUT_POOL_HOOKS,		// Input hooks
+	NUM_INPUT_POOLS
+} INPUT_POOL;
+
+typedef struct {
+	uint32 object_size;		/* Size of a single object in bytes. */
+	uint32 used;			/* Number of objects currently allocated. */
+	uint32 capacity;		/* Number of objects the pool can hold without growing. */
+	uint32 slabs;			/* Number of slabs allocated. */
+	uint32 bytes;			/* Total memory used by the slabs. */
+} InputPoolStats;
+
+/**
+ * Input contexts. A context holds the hooks, binds, input state and event queue of one
+ * window, functions work on the context current on the calling thread (the default
+ * context set up by input_initialize unless changed with input_set_context). Separate
+ * contexts may be dispatched on separate threads. Trace recording, latency statistics
+ * and the dispatch timeline cover only the default context. A context must not be
+ * current on another thread when it is destroyed.
+ */
+typedef struct InputContext input_context_t;
+
+/**
+ * Registering from handlers and other threads.
+ *
+ * Hooks and binds added or removed by a handler while an event is being dispatched
+ * are linked or unlinked once the dispatch is over (including any events dispatched
+ * from within the handlers). A new hook or bind is not called for the event being
+ * dispatched, and a removed one is still called for it unless an earlier handler
+ * consumes the event. Removed binds and their handles stay valid until then.
+ *
+ * The dispatching thread is the one which initialized the context, until another thread
+ * calls input_set_dispatch_thread or input_dispatch_pending while no events are being
+ * dispatched. input_add_*, input_remove_*, input_enable_bind, input_set_bind_* and
+ * input_set_mousebind_* may also be called from other threads, the change is applied by
+ * the dispatching thread before its next event. Binds added by other threads go to the
+ * default layer. All other functions must be called from the dispatching thread.
+ */
+
 /**
  * Typedefs for key/mouse bind data and bind/hook functions.
  */
 typedef struct KeyBind		KeyBind;
 typedef struct MouseBind	MouseBind;
 
+/**
+ * Bind handles. A handle becomes stale when its bind is removed and is then rejected
+ * by every function taking one.
+ */
+typedef uint32 input_bind_t;
+
+#define INPUT_INVALID_BIND		0
+
+/**
+ * Handler profiling.
+ *
+ * When the library is built with INPUT_PROFILE, every call to a hook or bind
+ * handler is timed and counted. input_get_handler_profile fills the given array
+ * with the handlers which have used the most time in total, in descending order,
+ * and returns the number of entries filled. The statistics are kept with the hook
+ * or bind and go away when it is removed. Without INPUT_PROFILE the handlers are
+ * called directly and input_get_handler_profile always returns 0.
+ */
+typedef enum {
+	INPUT_HANDLER_HOOK,		// Input hook
+	INPUT_HANDLER_KEYBIND,	// Character, key, chord or sequence bind
+	INPUT_HANDLER_MOUSEBIND,// Mouse move or button bind
+} INPUT_HANDLER_TYPE;
+
+typedef struct {
+	INPUT_HANDLER_TYPE type;	/* Type of the handler. */
+	void* handler;				/* Address of the handler function. */
+	input_bind_t bind;			/* Handle of the bind, INPUT_INVALID_BIND for hooks. */
+	INPUT_EVENT event;			/* Event the handler is called for. */
+	uint32 calls;				/* Number of calls. */
+	uint32 consumed;			/* Number of calls which consumed the event. */
+	uint64 total_time;			/* Time spent in the handler in nanoseconds. */
+	uint64 max_time;			/* Longest single call in nanoseconds. */
+} InputHandlerProfile;
+
 typedef bool			( *input_handler_t )			( InputEvent* event );
 typedef bool			( *keybind_func_t )				( uint32 key, void* data );
 typedef bool			( *mousebind_func_t )			( MOUSEBTN button, uint16 x, uint16 y, void* data );
@@ -102,6 +429,12 @@ MYLLY_API void			input_initialize				( void* window );
 MYLLY_API void			input_shutdown					( void );
 MYLLY_API bool			input_process					( void* data );
 
+MYLLY_API input_context_t*	input_create_context		( void* window );
+MYLLY_API void			input_destroy_context			( input_context_t* context );
+MYLLY_API input_context_t*	input_set_context			( input_context_t* context );
+MYLLY_API input_context_t*	input_get_context			( void );
+MYLLY_API void			input_set_dispatch_thread		( void );
+
 MYLLY_API void			input_enable_hook				( bool enable );
 
 MYLLY_API void			input_add_hook					( INPUT_EVENT event, input_handler_t handler );
@@ -110,6 +443,8 @@ MYLLY_API void			input_remove_hook				( INPUT_EVENT event, input_handler_t handl
 MYLLY_API KeyBind*		input_add_char_bind				( uint32 key, keybind_func_t func, void* data );
 MYLLY_API KeyBind*		input_add_key_up_bind			( uint32 key, keybind_func_t func, void* data );
 MYLLY_API KeyBind*		input_add_key_down_bind			( uint32 key, keybind_func_t func, void* data );
+MYLLY_API KeyBind*		input_add_chord_bind			( uint32 key, uint32 modifiers, keybind_func_t func, void* data );
+MYLLY_API KeyBind*		input_add_sequence_bind			( const InputKeyStroke* keys, uint32 count, uint32 timeout, keybind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mouse_move_bind		( rectangle_t* r, mousebind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mousebtn_up_bind		( MOUSEBTN button, rectangle_t* r, mousebind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mousebtn_down_bind	( MOUSEBTN button, rectangle_t* r, mousebind_func_t func, void* data );
@@ -117,18 +452,63 @@ MYLLY_API MouseBind*	input_add_mousebtn_down_bind	( MOUSEBTN button, rectangle_t
 MYLLY_API void			input_remove_char_bind			( uint32 key, keybind_func_t func );
 MYLLY_API void			input_remove_key_up_bind		( uint32 key, keybind_func_t func );
 MYLLY_API void			input_remove_key_down_bind		( uint32 key, keybind_func_t func );
+MYLLY_API void			input_remove_chord_bind			( uint32 key, uint32 modifiers, keybind_func_t func );
+MYLLY_API void			input_remove_sequence_bind		( const InputKeyStroke* keys, uint32 count, keybind_func_t func );
 MYLLY_API void			input_remove_mouse_move_bind	( mousebind_func_t func );
 MYLLY_API void			input_remove_mousebtn_up_bind	( MOUSEBTN button, mousebind_func_t func );
 MYLLY_API void			input_remove_mousebtn_down_bind	( MOUSEBTN button, mousebind_func_t func );
 MYLLY_API void			input_remove_key_bind			( KeyBind* bind );
 MYLLY_API void			input_remove_mouse_bind			( MouseBind* bind );
 
+MYLLY_API void			input_reset_sequences			( void );
+
+MYLLY_API input_bind_t	input_get_key_bind_handle		( KeyBind* bind );
+MYLLY_API input_bind_t	input_get_mouse_bind_handle		( MouseBind* bind );
+MYLLY_API KeyBind*		input_get_key_bind				( input_bind_t handle );
+MYLLY_API MouseBind*	input_get_mouse_bind			( input_bind_t handle );
+MYLLY_API bool			input_is_bind_valid				( input_bind_t handle );
+MYLLY_API bool			input_remove_bind				( input_bind_t handle );
+MYLLY_API bool			input_enable_bind				( input_bind_t handle, bool enable );
+MYLLY_API bool			input_set_bind_param			( input_bind_t handle, void* data );
+MYLLY_API bool			input_set_bind_rect				( input_bind_t handle, rectangle_t* r );
+
 MYLLY_API void			input_set_mousebind_button		( MouseBind* bind, MOUSEBTN button );
 MYLLY_API void			input_set_mousebind_rect		( MouseBind* bind, rectangle_t* r );
 MYLLY_API void			input_set_mousebind_func		( MouseBind* bind, mousebind_func_t func );
 MYLLY_API void			input_set_mousebind_param		( MouseBind* bind, void* data );
 
+MYLLY_API input_layer_t	input_create_layer				( const char* name, uint32 flags );
+MYLLY_API input_layer_t	input_find_layer				( const char* name );
+MYLLY_API bool			input_push_layer				( input_layer_t layer );
+MYLLY_API input_layer_t	input_pop_layer					( void );
+MYLLY_API bool			input_enable_layer				( input_layer_t layer, bool enable );
+MYLLY_API bool			input_is_layer_active			( input_layer_t layer );
+MYLLY_API input_layer_t	input_set_bind_layer			( input_layer_t layer );
+
+MYLLY_API bool			input_get_pool_stats			( INPUT_POOL pool, InputPoolStats* stats );
+
+MYLLY_API bool			input_enable_queue				( uint32 capacity, INPUT_QUEUE_POLICY policy );
+MYLLY_API void			input_disable_queue				( void );
+MYLLY_API uint32		input_dispatch_pending			( void );
+MYLLY_API void			input_get_queue_stats			( InputQueueStats* stats );
+
+MYLLY_API void			input_coalesce_motion			( bool enable );
+MYLLY_API void			input_flush_motion				( void );
+
+MYLLY_API const InputFrame*	input_begin_frame			( void );
+MYLLY_API const InputFrame*	input_get_frame				( void );
+MYLLY_API bool			input_is_key_down				( uint32 key );
+MYLLY_API bool			input_was_key_pressed			( uint32 key );
+MYLLY_API bool			input_was_key_released			( uint32 key );
+MYLLY_API bool			input_is_button_down			( MOUSEBTN button );
+MYLLY_API bool			input_was_button_pressed		( MOUSEBTN button );
+MYLLY_API bool			input_was_button_released		( MOUSEBTN button );
+
+MYLLY_API uint64		input_get_time					( void );
+MYLLY_API uint64		input_get_event_time			( void );
+
 MYLLY_API bool			input_get_key_state				( uint32 key );
+MYLLY_API uint32		input_get_modifiers				( void );
 MYLLY_API void			input_block_keys				( bool block );
 
 MYLLY_API void			input_show_mouse_cursor			( bool show );
@@ -137,6 +517,33 @@ MYLLY_API bool			input_is_cursor_showing			( void );
 MYLLY_API void			input_get_cursor_pos			( int16* x, int16* y );
 MYLLY_API void			input_set_cursor_pos			( int16 x, int16 y );
 
+MYLLY_API bool			input_set_relative_mouse		( bool enable );
+MYLLY_API bool			input_is_relative_mouse			( void );
+
+MYLLY_API bool			input_inject_key				( uint32 key, bool down );
+MYLLY_API bool			input_inject_char				( uint32 character );
+MYLLY_API bool			input_inject_motion				( int16 x, int16 y );
+MYLLY_API bool			input_inject_relative			( float dx, float dy );
+MYLLY_API bool			input_inject_button				( MOUSEBTN button, bool down );
+MYLLY_API bool			input_inject_wheel				( MOUSEWHEEL wheel );
+
+MYLLY_API bool			input_start_recording			( const char* path );
+MYLLY_API bool			input_stop_recording			( void );
+MYLLY_API bool			input_is_recording				( void );
+MYLLY_API bool			input_replay					( const char* path, INPUT_REPLAY_MODE mode );
+
+MYLLY_API void			input_enable_latency_stats		( bool enable );
+MYLLY_API bool			input_get_latency_stats			( INPUT_EVENT type, InputLatencyStats* stats );
+MYLLY_API void			input_reset_latency_stats		( void );
+MYLLY_API uint64		input_get_latency_bucket_value	( uint32 bucket );
+
+MYLLY_API void			input_enable_timeline			( uint32 capacity );
+MYLLY_API void			input_clear_timeline			( void );
+MYLLY_API bool			input_write_timeline			( const char* path, INPUT_TIMELINE_FORMAT format );
+
+MYLLY_API uint32		input_get_handler_profile		( InputHandlerProfile* profiles, uint32 max );
+MYLLY_API void			input_reset_handler_profile		( void );
+
 __END_DECLS
 
 #endif /* __MYLLY_INPUT_H */
@@ -0,0 +1,98 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputAtomic.h
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Minimal atomic operations for lock-free structures.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#pragma once
+#ifndef __MYLLY_INPUT_ATOMIC_H
+#define __MYLLY_INPUT_ATOMIC_H
+
+#include "stdtypes.h"
+
+// Loads with acquire and stores with release semantics. On MSVC this relies on x86
+// ordering, the compiler barrier only prevents the accesses from being reordered.
+#ifdef _MSC_VER
+
+#include <intrin.h>
+
+static __inline uint32 input_atomic_load( volatile uint32* ptr )
+{
+	uint32 value = *ptr;
+	_ReadWriteBarrier();
+	return value;
+}
+
+static __inline void input_atomic_store( volatile uint32* ptr, uint32 value )
+{
+	_ReadWriteBarrier();
+	*ptr = value;
+}
+
+#define input_atomic_exchange( ptr, value )	( (uint32)_InterlockedExchange( (volatile long*)(ptr), (long)(value) ) )
+#define input_atomic_cas( ptr, expected, value )	\
+	( _InterlockedCompareExchange( (volatile long*)(ptr), (long)(value), (long)(expected) ) == (long)(expected) )
+
+static __inline void* input_atomic_load_ptr_( void* volatile* ptr )
+{
+	void* value = *ptr;
+	_ReadWriteBarrier();
+	return value;
+}
+
+static __inline void input_atomic_store_ptr_( void* volatile* ptr, void* value )
+{
+	_ReadWriteBarrier();
+	*ptr = value;
+}
+
+#define input_atomic_load_ptr( ptr )				input_atomic_load_ptr_( (void* volatile*)(ptr) )
+#define input_atomic_store_ptr( ptr, value )		input_atomic_store_ptr_( (void* volatile*)(ptr), (void*)(value) )
+#define input_atomic_exchange_ptr( ptr, value )		_InterlockedExchangePointer( (void* volatile*)(ptr), (void*)(value) )
+#define input_atomic_cas_ptr( ptr, expected, value )	\
+	( _InterlockedCompareExchangePointer( (void* volatile*)(ptr), (void*)(value), (void*)(expected) ) == (void*)(expected) )
+
+#else
+
+#define input_atomic_load( ptr )			__atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+#define input_atomic_store( ptr, value )	__atomic_store_n( ptr, value, __ATOMIC_RELEASE )
+#define input_atomic_exchange( ptr, value )	__atomic_exchange_n( ptr, value, __ATOMIC_ACQ_REL )
+#define input_atomic_cas( ptr, expected, value )	__sync_bool_compare_and_swap( ptr, expected, value )
+
+#define input_atomic_load_ptr( ptr )					__atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+#define input_atomic_store_ptr( ptr, value )			__atomic_store_n( ptr, value, __ATOMIC_RELEASE )
+#define input_atomic_exchange_ptr( ptr, value )			__atomic_exchange_n( ptr, value, __ATOMIC_ACQ_REL )
+#define input_atomic_cas_ptr( ptr, expected, value )	__sync_bool_compare_and_swap( ptr, expected, value )
+
+#endif
+
+// Spin lock for short critical sections shared by the input thread and its readers
+static __inline void input_spin_lock( volatile uint32* lock )
+{
+	while ( input_atomic_exchange( lock, 1 ) )
+	{
+		while ( input_atomic_load( lock ) ) {}
+	}
+}
+
+static __inline void input_spin_unlock( volatile uint32* lock )
+{
+	input_atomic_store( lock, 0 );
+}
+
+// Size of a cache line, used to keep data written by different threads apart
+#define INPUT_CACHE_LINE	64
+
+// Storage class of variables with a separate instance for each thread
+#ifdef _MSC_VER
+#define INPUT_THREAD_LOCAL	__declspec(thread)
+#else
+#define INPUT_THREAD_LOCAL	__thread
+#endif
+
+#endif /* __MYLLY_INPUT_ATOMIC_H */
@@ -0,0 +1,67 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputClock.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Conversion of window system event times to the
+ *				monotonic clock used for input timestamps.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// Event times reported by the window system (X server time, MSG::time) are 32-bit
+// millisecond counters on a clock of their own. The offset to the local clock is
+// estimated from the events themselves: an event is always received after it was
+// generated, so the smallest observed difference between the local receive time and
+// the event time is the best estimate of the offset. To follow drift between the two
+// clocks the estimate is allowed to creep forward by INPUT_CLOCK_DRIFT_PPM of the
+// elapsed time, while a smaller observation always replaces it immediately.
+#define INPUT_CLOCK_DRIFT_PPM	200
+
+// --------------------------------------------------
+
+void input_clock_reset( InputClockSync* sync )
+{
+	memset( sync, 0, sizeof(*sync) );
+}
+
+uint64 input_clock_convert( InputClockSync* sync, uint32 event_ms, uint64 now )
+{
+	int64 offset, observed, event_ns;
+	uint64 elapsed;
+
+	if ( !sync->valid )
+	{
+		sync->event_base = event_ms;
+		sync->last_event = event_ms;
+		sync->last_local = now;
+		sync->offset = (int64)now - (int64)event_ms * 1000000;
+		sync->valid = true;
+
+		return now;
+	}
+
+	// Extend the event clock to 64 bits, it wraps around every 49.7 days. Events may
+	// also arrive slightly out of order so the difference is treated as signed.
+	sync->event_base += (int64)(int32)( event_ms - sync->last_event );
+	sync->last_event = event_ms;
+
+	event_ns = sync->event_base * 1000000;
+	observed = (int64)now - event_ns;
+
+	elapsed = now > sync->last_local ? now - sync->last_local : 0;
+	sync->last_local = now;
+
+	offset = sync->offset + (int64)( elapsed / ( 1000000 / INPUT_CLOCK_DRIFT_PPM ) );
+	sync->offset = observed < offset ? observed : offset;
+
+	// Never report an event as happening after it was received
+	event_ns += sync->offset;
+	return event_ns < (int64)now ? (uint64)event_ns : now;
+}
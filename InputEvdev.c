@@ -0,0 +1,721 @@
+/**********************************************************************
+ *
+ * PROJECT:		Input library
+ * FILE:		InputEvdev.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Functions to read Linux event devices directly.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#if defined(__linux__) && defined(INPUT_EVDEV) && !defined(INPUT_HEADLESS)
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <linux/input.h>
+#include <X11/X.h>
+#include <X11/keysym.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------
+
+// Keys are reported with the same X keysyms as on X11 so binds work the same on both,
+// translated with a US layout. Pointer motion, buttons and the wheel are collected
+// until the end of the report (SYN_REPORT) they belong to, so the position is updated
+// before the buttons pressed at it are posted.
+#define EVDEV_BATCH			64		// Events read with a single read call
+
+// Buttons of a pointer device which are passed on
+static const struct {
+	uint16		code;
+	MOUSEBTN	button;
+	INPUT_EVENT	down;
+	INPUT_EVENT	up;
+} evdev_buttons[] = {
+	{ BTN_LEFT,		MOUSE_LBUTTON,	INPUT_LBUTTON_DOWN,	INPUT_LBUTTON_UP },
+	{ BTN_TOUCH,	MOUSE_LBUTTON,	INPUT_LBUTTON_DOWN,	INPUT_LBUTTON_UP },
+	{ BTN_RIGHT,	MOUSE_RBUTTON,	INPUT_RBUTTON_DOWN,	INPUT_RBUTTON_UP },
+	{ BTN_MIDDLE,	MOUSE_MBUTTON,	INPUT_MBUTTON_DOWN,	INPUT_MBUTTON_UP },
+};
+
+#define EVDEV_BUTTONS		( sizeof(evdev_buttons) / sizeof(evdev_buttons[0]) )
+
+// Unshifted and shifted keysym of each key code
+static const uint32 evdev_keysyms[KEY_COMPOSE+1][2] = {
+	[KEY_ESC]			= { XK_Escape, XK_Escape },
+	[KEY_1]				= { XK_1, XK_exclam },
+	[KEY_2]				= { XK_2, XK_at },
+	[KEY_3]				= { XK_3, XK_numbersign },
+	[KEY_4]				= { XK_4, XK_dollar },
+	[KEY_5]				= { XK_5, XK_percent },
+	[KEY_6]				= { XK_6, XK_asciicircum },
+	[KEY_7]				= { XK_7, XK_ampersand },
+	[KEY_8]				= { XK_8, XK_asterisk },
+	[KEY_9]				= { XK_9, XK_parenleft },
+	[KEY_0]				= { XK_0, XK_parenright },
+	[KEY_MINUS]			= { XK_minus, XK_underscore },
+	[KEY_EQUAL]			= { XK_equal, XK_plus },
+	[KEY_BACKSPACE]		= { XK_BackSpace, XK_BackSpace },
+	[KEY_TAB]			= { XK_Tab, XK_ISO_Left_Tab },
+	[KEY_Q]				= { XK_q, XK_Q },
+	[KEY_W]				= { XK_w, XK_W },
+	[KEY_E]				= { XK_e, XK_E },
+	[KEY_R]				= { XK_r, XK_R },
+	[KEY_T]				= { XK_t, XK_T },
+	[KEY_Y]				= { XK_y, XK_Y },
+	[KEY_U]				= { XK_u, XK_U },
+	[KEY_I]				= { XK_i, XK_I },
+	[KEY_O]				= { XK_o, XK_O },
+	[KEY_P]				= { XK_p, XK_P },
+	[KEY_LEFTBRACE]		= { XK_bracketleft, XK_braceleft },
+	[KEY_RIGHTBRACE]	= { XK_bracketright, XK_braceright },
+	[KEY_ENTER]			= { XK_Return, XK_Return },
+	[KEY_LEFTCTRL]		= { XK_Control_L, XK_Control_L },
+	[KEY_A]				= { XK_a, XK_A },
+	[KEY_S]				= { XK_s, XK_S },
+	[KEY_D]				= { XK_d, XK_D },
+	[KEY_F]				= { XK_f, XK_F },
+	[KEY_G]				= { XK_g, XK_G },
+	[KEY_H]				= { XK_h, XK_H },
+	[KEY_J]				= { XK_j, XK_J },
+	[KEY_K]				= { XK_k, XK_K },
+	[KEY_L]				= { XK_l, XK_L },
+	[KEY_SEMICOLON]		= { XK_semicolon, XK_colon },
+	[KEY_APOSTROPHE]	= { XK_apostrophe, XK_quotedbl },
+	[KEY_GRAVE]			= { XK_grave, XK_asciitilde },
+	[KEY_LEFTSHIFT]		= { XK_Shift_L, XK_Shift_L },
+	[KEY_BACKSLASH]		= { XK_backslash, XK_bar },
+	[KEY_Z]				= { XK_z, XK_Z },
+	[KEY_X]				= { XK_x, XK_X },
+	[KEY_C]				= { XK_c, XK_C },
+	[KEY_V]				= { XK_v, XK_V },
+	[KEY_B]				= { XK_b, XK_B },
+	[KEY_N]				= { XK_n, XK_N },
+	[KEY_M]				= { XK_m, XK_M },
+	[KEY_COMMA]			= { XK_comma, XK_less },
+	[KEY_DOT]			= { XK_period, XK_greater },
+	[KEY_SLASH]			= { XK_slash, XK_question },
+	[KEY_RIGHTSHIFT]	= { XK_Shift_R, XK_Shift_R },
+	[KEY_KPASTERISK]	= { XK_KP_Multiply, XK_KP_Multiply },
+	[KEY_LEFTALT]		= { XK_Alt_L, XK_Meta_L },
+	[KEY_SPACE]			= { XK_space, XK_space },
+	[KEY_CAPSLOCK]		= { XK_Caps_Lock, XK_Caps_Lock },
+	[KEY_F1]			= { XK_F1, XK_F1 },
+	[KEY_F2]			= { XK_F2, XK_F2 },
+	[KEY_F3]			= { XK_F3, XK_F3 },
+	[KEY_F4]			= { XK_F4, XK_F4 },
+	[KEY_F5]			= { XK_F5, XK_F5 },
+	[KEY_F6]			= { XK_F6, XK_F6 },
+	[KEY_F7]			= { XK_F7, XK_F7 },
+	[KEY_F8]			= { XK_F8, XK_F8 },
+	[KEY_F9]			= { XK_F9, XK_F9 },
+	[KEY_F10]			= { XK_F10, XK_F10 },
+	[KEY_NUMLOCK]		= { XK_Num_Lock, XK_Num_Lock },
+	[KEY_SCROLLLOCK]	= { XK_Scroll_Lock, XK_Scroll_Lock },
+	[KEY_KP7]			= { XK_KP_Home, XK_KP_7 },
+	[KEY_KP8]			= { XK_KP_Up, XK_KP_8 },
+	[KEY_KP9]			= { XK_KP_Prior, XK_KP_9 },
+	[KEY_KPMINUS]		= { XK_KP_Subtract, XK_KP_Subtract },
+	[KEY_KP4]			= { XK_KP_Left, XK_KP_4 },
+	[KEY_KP5]			= { XK_KP_Begin, XK_KP_5 },
+	[KEY_KP6]			= { XK_KP_Right, XK_KP_6 },
+	[KEY_KPPLUS]		= { XK_KP_Add, XK_KP_Add },
+	[KEY_KP1]			= { XK_KP_End, XK_KP_1 },
+	[KEY_KP2]			= { XK_KP_Down, XK_KP_2 },
+	[KEY_KP3]			= { XK_KP_Next, XK_KP_3 },
+	[KEY_KP0]			= { XK_KP_Insert, XK_KP_0 },
+	[KEY_KPDOT]			= { XK_KP_Delete, XK_KP_Decimal },
+	[KEY_102ND]			= { XK_less, XK_greater },
+	[KEY_F11]			= { XK_F11, XK_F11 },
+	[KEY_F12]			= { XK_F12, XK_F12 },
+	[KEY_KPENTER]		= { XK_KP_Enter, XK_KP_Enter },
+	[KEY_RIGHTCTRL]		= { XK_Control_R, XK_Control_R },
+	[KEY_KPSLASH]		= { XK_KP_Divide, XK_KP_Divide },
+	[KEY_SYSRQ]			= { XK_Print, XK_Sys_Req },
+	[KEY_RIGHTALT]		= { XK_Alt_R, XK_Meta_R },
+	[KEY_HOME]			= { XK_Home, XK_Home },
+	[KEY_UP]			= { XK_Up, XK_Up },
+	[KEY_PAGEUP]		= { XK_Page_Up, XK_Page_Up },
+	[KEY_LEFT]			= { XK_Left, XK_Left },
+	[KEY_RIGHT]			= { XK_Right, XK_Right },
+	[KEY_END]			= { XK_End, XK_End },
+	[KEY_DOWN]			= { XK_Down, XK_Down },
+	[KEY_PAGEDOWN]		= { XK_Page_Down, XK_Page_Down },
+	[KEY_INSERT]		= { XK_Insert, XK_Insert },
+	[KEY_DELETE]		= { XK_Delete, XK_Delete },
+	[KEY_PAUSE]			= { XK_Pause, XK_Break },
+	[KEY_LEFTMETA]		= { XK_Super_L, XK_Super_L },
+	[KEY_RIGHTMETA]		= { XK_Super_R, XK_Super_R },
+	[KEY_COMPOSE]		= { XK_Menu, XK_Menu },
+};
+
+// State of a single event device
+typedef struct {
+	int					fd;
+	bool				closed;			// Has the device been unplugged or the stream ended
+	bool				dropped;		// Did the kernel drop events, ignore the rest of the report
+	bool				monotonic;		// Are the events stamped with the monotonic clock
+	bool				time_base_set;
+	uint64				time_base;		// Added to the times of recorded events
+	int32				abs_min[2];		// Range of the absolute X and Y axes, empty if unknown
+	int32				abs_max[2];
+	int32				abs[2];			// Absolute position in the current report
+	bool				abs_moved;
+	int32				rel[2];			// Relative motion in the current report
+	int32				wheel;			// Wheel steps in the current report, up is positive
+	uint32				pressed;		// Buttons pressed and released in the current report,
+	uint32				released;		// a bit for each entry of evdev_buttons
+	uint32				fill;			// Bytes of a partial event left by the previous read
+	struct input_event	buffer[EVDEV_BATCH];
+} InputEvdevDevice;
+
+// Backend state of a context
+typedef struct {
+	InputEvdevDevice*	devices;
+	uint32				count;
+	int16				width;			// Size of the screen, 0 if not known
+	int16				height;
+	int32				x;				// Pointer position
+	int32				y;
+	InputKeyMap			key_codes;		// Keysyms of evdev_keysyms to key codes
+} InputEvdev;
+
+#define input_evdev() ( (InputEvdev*)input_context_state()->platform )
+
+// --------------------------------------------------
+
+static uint32 input_get_modifier( uint32 sym )
+{
+	switch ( sym )
+	{
+	case XK_Shift_L: return INPUT_MOD_LSHIFT;
+	case XK_Shift_R: return INPUT_MOD_RSHIFT;
+	case XK_Control_L: return INPUT_MOD_LCONTROL;
+	case XK_Control_R: return INPUT_MOD_RCONTROL;
+	case XK_Alt_L: case XK_Meta_L: return INPUT_MOD_LALT;
+	case XK_Alt_R: case XK_Meta_R: case XK_ISO_Level3_Shift: return INPUT_MOD_RALT;
+	case XK_Super_L: return INPUT_MOD_LSUPER;
+	case XK_Super_R: return INPUT_MOD_RSUPER;
+	}
+
+	return 0;
+}
+
+static void input_update_locks( uint32 sym )
+{
+	uint32 locks;
+
+	// There is no server keeping track of the locks, they toggle on every press
+	locks = input_get_modifiers() & INPUT_MOD_LOCKS;
+
+	switch ( sym )
+	{
+	case XK_Caps_Lock: locks ^= INPUT_MOD_CAPSLOCK; break;
+	case XK_Num_Lock: locks ^= INPUT_MOD_NUMLOCK; break;
+	case XK_Scroll_Lock: locks ^= INPUT_MOD_SCROLLLOCK; break;
+	default: return;
+	}
+
+	input_set_lock_state( locks );
+}
+
+static uint32 input_lookup_keysym( uint16 code, uint32 modifiers )
+{
+	uint32 lower, upper;
+	bool shift;
+
+	if ( code >= KEY_COMPOSE+1 ) return NoSymbol;
+
+	lower = evdev_keysyms[code][0];
+	upper = evdev_keysyms[code][1];
+
+	shift = ( modifiers & INPUT_MOD_SHIFT ) != 0;
+
+	// Num lock inverts shift on the keypad, caps lock on letters
+	if ( upper >= XK_KP_Space && upper <= XK_KP_Equal )
+	{
+		if ( modifiers & INPUT_MOD_NUMLOCK ) shift = !shift;
+	}
+	else if ( ( modifiers & INPUT_MOD_CAPSLOCK ) && lower >= XK_a && lower <= XK_z )
+	{
+		shift = !shift;
+	}
+
+	return shift ? upper : lower;
+}
+
+static uint32 input_get_keysym_char( uint32 sym, uint32 modifiers )
+{
+	// Latin-1 keysyms are the characters themselves
+	if ( ( sym >= 0x20 && sym <= 0x7E ) || ( sym >= 0xA0 && sym <= 0xFF ) )
+	{
+		if ( ( modifiers & INPUT_MOD_CONTROL ) && sym >= '@' && sym <= '~' ) return sym & 0x1F;
+		return sym;
+	}
+
+	switch ( sym )
+	{
+	case XK_BackSpace: case XK_Tab: case XK_Return: case XK_Escape: case XK_Delete:
+		return sym & 0x7F;
+
+	case XK_KP_Enter: return '\r';
+	}
+
+	// From * to 9 the keypad keysyms follow the order of ASCII
+	if ( sym >= XK_KP_Multiply && sym <= XK_KP_9 ) return sym - XK_KP_Multiply + '*';
+
+	return 0;
+}
+
+static void input_sync_keys( InputEvdev* evdev )
+{
+	uint8 keys[KEY_MAX/8+1];
+	uint8 state[INPUT_KEY_STATE_SIZE/8];
+	uint32 i, j, modifiers = 0;
+
+	memset( state, 0, sizeof(state) );
+
+	// Streams other than event devices start with all keys up
+	for ( i = 0; i < evdev->count; i++ )
+	{
+		if ( evdev->devices[i].closed ) continue;
+
+		memset( keys, 0, sizeof(keys) );
+		if ( ioctl( evdev->devices[i].fd, EVIOCGKEY( sizeof(keys) ), keys ) < 0 ) continue;
+
+		for ( j = 0; j < sizeof(state); j++ )
+			state[j] |= keys[j];
+	}
+
+	// Modifiers held down when the devices were opened are only seen through the bitmap
+	for ( i = 0; i < INPUT_KEY_STATE_SIZE; i++ )
+	{
+		if ( state[i/8] & ( 1 << ( i % 8 ) ) )
+			modifiers |= input_get_modifier( input_lookup_keysym( (uint16)i, 0 ) );
+	}
+
+	input_set_key_states( state );
+
+	input_set_modifiers( ~INPUT_MOD_LOCKS, false );
+	input_set_modifiers( modifiers, true );
+}
+
+static void input_open_device( InputEvdevDevice* device, int fd )
+{
+	struct input_absinfo abs;
+	int clock = CLOCK_MONOTONIC, flags, i;
+
+	device->fd = fd;
+
+	flags = fcntl( fd, F_GETFL );
+	if ( flags >= 0 ) fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+
+	// Event devices use the realtime clock unless told otherwise
+	device->monotonic = ioctl( fd, EVIOCSCLOCKID, &clock ) == 0;
+
+	for ( i = 0; i < 2; i++ )
+	{
+		if ( ioctl( fd, EVIOCGABS( ABS_X + i ), &abs ) == 0 && abs.maximum > abs.minimum )
+		{
+			device->abs_min[i] = abs.minimum;
+			device->abs_max[i] = abs.maximum;
+		}
+	}
+}
+
+void input_platform_initialize( void* wnd )
+{
+	InputEvdevWindow* window = (InputEvdevWindow*)wnd;
+	InputEvdev* evdev;
+	uint32 i;
+
+	if ( window == NULL || ( window->count && window->fds == NULL ) ) return;
+
+	evdev = mem_alloc_clean( sizeof(*evdev) );
+	if ( evdev == NULL ) return;
+
+	if ( window->count )
+	{
+		evdev->devices = mem_alloc_clean( window->count * sizeof(InputEvdevDevice) );
+
+		if ( evdev->devices == NULL )
+		{
+			mem_free( evdev );
+			return;
+		}
+	}
+
+	evdev->count = window->count;
+	evdev->width = window->width;
+	evdev->height = window->height;
+	evdev->x = window->width / 2;
+	evdev->y = window->height / 2;
+
+	// The lowest key code producing a keysym shifted or not wins
+	if ( input_keymap_create( &evdev->key_codes, 2 * ( KEY_COMPOSE+1 ) ) )
+	{
+		for ( i = 0; i < KEY_COMPOSE+1; i++ )
+		{
+			input_keymap_add( &evdev->key_codes, evdev_keysyms[i][0], i );
+			input_keymap_add( &evdev->key_codes, evdev_keysyms[i][1], i );
+		}
+	}
+
+	for ( i = 0; i < evdev->count; i++ )
+		input_open_device( &evdev->devices[i], window->fds[i] );
+
+	input_context_state()->platform = evdev;
+
+	input_sync_keys( evdev );
+}
+
+void input_platform_shutdown( void )
+{
+	InputContextState* state = input_context_state();
+	InputEvdev* evdev = (InputEvdev*)state->platform;
+
+	// The descriptors belong to the application
+	if ( evdev != NULL )
+	{
+		if ( evdev->devices ) mem_free( evdev->devices );
+		input_keymap_destroy( &evdev->key_codes );
+		mem_free( evdev );
+	}
+
+	state->platform = NULL;
+}
+
+uint64 input_platform_get_time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64)ts.tv_sec * 1000000000 + (uint64)ts.tv_nsec;
+}
+
+static void input_update_event_time( InputEvdevDevice* device, const struct input_event* event )
+{
+	uint64 time;
+
+	time = (uint64)event->input_event_sec * 1000000000 + (uint64)event->input_event_usec * 1000;
+
+	// Recorded events keep their spacing, the first one happens when it is read
+	if ( !device->monotonic )
+	{
+		if ( !device->time_base_set )
+		{
+			device->time_base = input_platform_get_time() - time;
+			device->time_base_set = true;
+		}
+
+		time += device->time_base;
+	}
+
+	input_set_event_time( time );
+}
+
+void input_enable_hook( bool enable )
+{
+	// Event devices are read directly, there is nothing to hook.
+	UNREFERENCED_PARAM( enable );
+}
+
+static void input_process_key( const struct input_event* event )
+{
+	uint32 sym, code, modifiers;
+
+	// Autorepeat (value 2) posts key down again like the window systems do
+	sym = input_lookup_keysym( event->code, 0 );
+
+	input_set_modifiers( input_get_modifier( sym ), event->value != 0 );
+	if ( event->value == 1 ) input_update_locks( sym );
+	input_set_key_state( event->code, event->value != 0 );
+
+	if ( sym == NoSymbol ) return;
+
+	if ( event->value == 0 )
+	{
+		input_post_key_event( INPUT_KEY_UP, sym );
+		return;
+	}
+
+	modifiers = input_get_modifiers();
+	sym = input_lookup_keysym( event->code, modifiers );
+	code = sym;
+
+	// A dodgy fix to make windows and linux hooks/binds compatible:
+	// Convert lowercase characters to upper case before processing hooks.
+	if ( code >= 'a' && code <= 'z' ) code -= ( 'a' - 'A' );
+
+	if ( !input_post_key_event( INPUT_KEY_DOWN, code ) ) return;
+
+	code = input_get_keysym_char( sym, modifiers );
+	if ( code != 0 ) input_post_key_event( INPUT_CHARACTER, code );
+}
+
+static int32 input_clamp_pointer( int32 value, int16 size )
+{
+	int32 max = size > 0 ? size - 1 : 0x7FFF;
+
+	if ( value < 0 ) return 0;
+	if ( value > max ) return max;
+	return value;
+}
+
+static int32 input_scale_abs( InputEvdevDevice* device, uint32 axis, int16 size )
+{
+	int32 min = device->abs_min[axis], max = device->abs_max[axis];
+
+	// Without a known range the values are taken as pixels
+	if ( max <= min || size <= 0 ) return device->abs[axis];
+
+	return (int32)( (int64)( device->abs[axis] - min ) * ( size - 1 ) / ( max - min ) );
+}
+
+static void input_process_report( InputEvdev* evdev, InputEvdevDevice* device )
+{
+	bool moved = false;
+	uint32 i;
+
+	if ( device->rel[0] != 0 || device->rel[1] != 0 )
+	{
+		if ( input_is_relative_mouse() )
+		{
+			input_post_relative_event( (float)device->rel[0], (float)device->rel[1] );
+		}
+		else
+		{
+			evdev->x += device->rel[0];
+			evdev->y += device->rel[1];
+			moved = true;
+		}
+	}
+
+	if ( device->abs_moved )
+	{
+		evdev->x = input_scale_abs( device, 0, evdev->width );
+		evdev->y = input_scale_abs( device, 1, evdev->height );
+		moved = true;
+	}
+
+	evdev->x = input_clamp_pointer( evdev->x, evdev->width );
+	evdev->y = input_clamp_pointer( evdev->y, evdev->height );
+
+	if ( moved )
+		input_post_mouse_event( INPUT_MOUSE_MOVE, (int16)evdev->x, (int16)evdev->y, MOUSE_NONE, MWHEEL_STATIONARY );
+
+	for ( i = 0; i < EVDEV_BUTTONS; i++ )
+	{
+		if ( device->pressed & ( 1 << i ) )
+			input_post_mouse_event( evdev_buttons[i].down, (int16)evdev->x, (int16)evdev->y, evdev_buttons[i].button, MWHEEL_STATIONARY );
+
+		if ( device->released & ( 1 << i ) )
+			input_post_mouse_event( evdev_buttons[i].up, (int16)evdev->x, (int16)evdev->y, evdev_buttons[i].button, MWHEEL_STATIONARY );
+	}
+
+	for ( ; device->wheel > 0; device->wheel-- )
+		input_post_mouse_event( INPUT_MOUSE_WHEEL, (int16)evdev->x, (int16)evdev->y, MOUSE_NONE, MWHEEL_UP );
+
+	for ( ; device->wheel < 0; device->wheel++ )
+		input_post_mouse_event( INPUT_MOUSE_WHEEL, (int16)evdev->x, (int16)evdev->y, MOUSE_NONE, MWHEEL_DOWN );
+}
+
+static void input_reset_report( InputEvdevDevice* device )
+{
+	device->abs_moved = false;
+	device->rel[0] = device->rel[1] = 0;
+	device->wheel = 0;
+	device->pressed = device->released = 0;
+}
+
+static void input_process_event( InputEvdev* evdev, InputEvdevDevice* device, const struct input_event* event )
+{
+	uint32 i;
+
+	// After the kernel has dropped events the rest of the report is incomplete
+	if ( device->dropped )
+	{
+		if ( event->type == EV_SYN && event->code == SYN_REPORT )
+		{
+			device->dropped = false;
+			input_sync_keys( evdev );
+		}
+
+		return;
+	}
+
+	input_update_event_time( device, event );
+
+	switch ( event->type )
+	{
+	case EV_KEY:
+		if ( event->code < BTN_MISC )
+		{
+			input_process_key( event );
+			break;
+		}
+
+		// Button repeats are meaningless
+		for ( i = 0; i < EVDEV_BUTTONS && event->value != 2; i++ )
+		{
+			if ( evdev_buttons[i].code != event->code ) continue;
+
+			if ( event->value ) device->pressed |= 1 << i;
+			else device->released |= 1 << i;
+		}
+		break;
+
+	case EV_REL:
+		switch ( event->code )
+		{
+		case REL_X: device->rel[0] += event->value; break;
+		case REL_Y: device->rel[1] += event->value; break;
+		case REL_WHEEL: device->wheel += event->value; break;
+		}
+		break;
+
+	case EV_ABS:
+		if ( event->code == ABS_X || event->code == ABS_Y )
+		{
+			device->abs[event->code - ABS_X] = event->value;
+			device->abs_moved = true;
+		}
+		break;
+
+	case EV_SYN:
+		if ( event->code == SYN_REPORT )
+		{
+			input_process_report( evdev, device );
+			input_reset_report( device );
+		}
+		else if ( event->code == SYN_DROPPED )
+		{
+			input_reset_report( device );
+			device->dropped = true;
+		}
+		break;
+	}
+}
+
+static void input_read_device( InputEvdev* evdev, InputEvdevDevice* device )
+{
+	ssize_t bytes;
+	uint32 size, count, i;
+
+	while ( !device->closed )
+	{
+		// Read as many events as fit in the buffer with a single call
+		bytes = read( device->fd, (uint8*)device->buffer + device->fill, sizeof(device->buffer) - device->fill );
+
+		if ( bytes < 0 )
+		{
+			if ( errno == EINTR ) continue;
+
+			// Unplugged devices fail with ENODEV
+			if ( errno != EAGAIN && errno != EWOULDBLOCK ) device->closed = true;
+			return;
+		}
+
+		if ( bytes == 0 )
+		{
+			device->closed = true;
+			return;
+		}
+
+		size = device->fill + (uint32)bytes;
+		count = size / sizeof(struct input_event);
+
+		for ( i = 0; i < count; i++ )
+		{
+			input_process_event( evdev, device, &device->buffer[i] );
+
+			// The context may have been shut down by a handler
+			if ( input_evdev() != evdev ) return;
+		}
+
+		// Pipes may split an event between reads, event devices never do
+		device->fill = size - count * sizeof(struct input_event);
+		if ( device->fill ) memmove( device->buffer, &device->buffer[count], device->fill );
+
+		// A short read means the device has been drained
+		if ( size < sizeof(device->buffer) ) return;
+	}
+}
+
+bool input_process( void* data )
+{
+	InputEvdev* evdev = input_evdev();
+	uint32 i;
+
+	if ( evdev == NULL ) return true;
+
+	for ( i = 0; i < evdev->count; i++ )
+	{
+		if ( data != NULL && evdev->devices[i].fd != *(int*)data ) continue;
+
+		input_read_device( evdev, &evdev->devices[i] );
+		if ( input_evdev() != evdev ) break;
+	}
+
+	return true;
+}
+
+uint32 input_platform_get_key_code( uint32 key )
+{
+	InputEvdev* evdev = input_evdev();
+
+	if ( evdev == NULL ) return INPUT_KEY_CODE_NONE;
+
+	return input_keymap_find( &evdev->key_codes, key );
+}
+
+void input_show_mouse_cursor( bool show )
+{
+	// There is no cursor, the application draws its own
+	input_context_state()->show_cursor = show;
+}
+
+void input_show_mouse_cursor_ref( bool show )
+{
+	InputContextState* state = input_context_state();
+
+	if ( !show )
+	{
+		if ( state->cursor_refs && --state->cursor_refs == 0 ) state->show_cursor = false;
+	}
+	else
+	{
+		if ( state->cursor_refs++ == 0 ) state->show_cursor = true;
+	}
+}
+
+void input_set_cursor_pos( int16 x, int16 y )
+{
+	InputContextState* state = input_context_state();
+	InputEvdev* evdev = input_evdev();
+
+	state->mouse_x = x;
+	state->mouse_y = y;
+
+	if ( evdev == NULL ) return;
+
+	evdev->x = x;
+	evdev->y = y;
+}
+
+bool input_platform_set_relative_mouse( bool enable )
+{
+	// Relative devices report raw motion anyway, in relative mode it doesn't move the pointer
+	UNREFERENCED_PARAM( enable );
+	return true;
+}
+
+#endif /* __linux__ && INPUT_EVDEV && !INPUT_HEADLESS */
@@ -0,0 +1,85 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputInject.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Synthetic input events for tests, benchmarks and
+ *				automation.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+
+// --------------------------------------------------
+
+// Injected events are stamped with the current time and posted exactly like the
+// events of a platform backend, including the modifier state and the key bitmap.
+// The position of the injected pointer is kept per context.
+
+// --------------------------------------------------
+
+bool input_inject_key( uint32 key, bool down )
+{
+	input_set_event_time( input_platform_get_time() );
+
+	input_set_modifiers( input_key_modifier_mask( key ), down );
+	input_set_key_state( input_platform_get_key_code( key ), down );
+
+	return input_post_key_event( down ? INPUT_KEY_DOWN : INPUT_KEY_UP, key );
+}
+
+bool input_inject_char( uint32 character )
+{
+	input_set_event_time( input_platform_get_time() );
+
+	return input_post_key_event( INPUT_CHARACTER, character );
+}
+
+bool input_inject_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	InputContextState* state = input_context_state();
+
+	input_set_event_time( input_platform_get_time() );
+
+	state->pointer_x = x;
+	state->pointer_y = y;
+
+	return input_post_mouse_event( type, x, y, button, wheel );
+}
+
+bool input_inject_motion( int16 x, int16 y )
+{
+	return input_inject_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
+}
+
+bool input_inject_relative( float dx, float dy )
+{
+	input_set_event_time( input_platform_get_time() );
+
+	return input_post_relative_event( dx, dy );
+}
+
+bool input_inject_button( MOUSEBTN button, bool down )
+{
+	InputContextState* state = input_context_state();
+	INPUT_EVENT type;
+
+	switch ( button )
+	{
+	case MOUSE_LBUTTON: type = down ? INPUT_LBUTTON_DOWN : INPUT_LBUTTON_UP; break;
+	case MOUSE_MBUTTON: type = down ? INPUT_MBUTTON_DOWN : INPUT_MBUTTON_UP; break;
+	case MOUSE_RBUTTON: type = down ? INPUT_RBUTTON_DOWN : INPUT_RBUTTON_UP; break;
+	default: return true;
+	}
+
+	return input_inject_mouse_event( type, state->pointer_x, state->pointer_y, button, MWHEEL_STATIONARY );
+}
+
+bool input_inject_wheel( MOUSEWHEEL wheel )
+{
+	InputContextState* state = input_context_state();
+
+	return input_inject_mouse_event( INPUT_MOUSE_WHEEL, state->pointer_x, state->pointer_y, MOUSE_NONE, wheel );
+}
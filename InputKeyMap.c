@@ -0,0 +1,90 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputKeyMap.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Keysym to key code lookup for the backends keeping
+ *				the keyboard mapping themselves.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+static uint32 input_keymap_hash( uint32 keysym )
+{
+	keysym ^= keysym >> 16;
+	keysym *= 0x85EBCA6B;
+	keysym ^= keysym >> 13;
+	keysym *= 0xC2B2AE35;
+	keysym ^= keysym >> 16;
+
+	return keysym;
+}
+
+bool input_keymap_create( InputKeyMap* map, uint32 capacity )
+{
+	uint32 size;
+
+	// Kept at most half full so probes stay short
+	for ( size = 16; size < capacity * 2; size <<= 1 ) {}
+
+	memset( map, 0, sizeof(*map) );
+
+	map->slots = mem_alloc_clean( size * sizeof(*map->slots) );
+	if ( map->slots == NULL ) return false;
+
+	map->mask = size - 1;
+
+	return true;
+}
+
+void input_keymap_destroy( InputKeyMap* map )
+{
+	if ( map->slots ) mem_free( map->slots );
+
+	memset( map, 0, sizeof(*map) );
+}
+
+void input_keymap_add( InputKeyMap* map, uint32 keysym, uint32 code )
+{
+	InputKeyMapSlot* slot;
+	uint32 i;
+
+	if ( map->slots == NULL || keysym == 0 || code == INPUT_KEY_CODE_NONE ) return;
+
+	for ( i = input_keymap_hash( keysym ) & map->mask;; i = ( i + 1 ) & map->mask )
+	{
+		slot = &map->slots[i];
+
+		if ( slot->code == INPUT_KEY_CODE_NONE )
+		{
+			slot->keysym = keysym;
+			slot->code = code;
+			return;
+		}
+
+		if ( slot->keysym == keysym ) return;
+	}
+}
+
+uint32 input_keymap_find( const InputKeyMap* map, uint32 keysym )
+{
+	const InputKeyMapSlot* slot;
+	uint32 i;
+
+	if ( map->slots == NULL || keysym == 0 ) return INPUT_KEY_CODE_NONE;
+
+	for ( i = input_keymap_hash( keysym ) & map->mask;; i = ( i + 1 ) & map->mask )
+	{
+		slot = &map->slots[i];
+
+		if ( slot->code == INPUT_KEY_CODE_NONE ) return INPUT_KEY_CODE_NONE;
+		if ( slot->keysym == keysym ) return slot->code;
+	}
+}
@@ -0,0 +1,140 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputLatency.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Per event type latency histograms.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// The histograms use logarithmic buckets with a fixed relative precision like HDR
+// histograms. Values below LATENCY_SUB_COUNT have a bucket each, above that every
+// power of two is split into LATENCY_SUB_COUNT linear buckets, so a value is never
+// off by more than 1/16 of itself. Values beyond 2^LATENCY_MAX_EXPONENT ns (~69 s)
+// go to the last bucket.
+#define LATENCY_SUB_BITS		4
+#define LATENCY_SUB_COUNT		( 1 << LATENCY_SUB_BITS )
+#define LATENCY_MAX_EXPONENT	35
+
+static bool latency_enabled = false;				// Are latencies being measured
+static InputLatencyStats latency[NUM_INPUT_EVENTS];	// Histograms per event type
+
+// --------------------------------------------------
+
+static uint32 input_latency_bucket( uint64 value )
+{
+	uint32 exponent;
+
+	if ( value < LATENCY_SUB_COUNT ) return (uint32)value;
+
+	exponent = input_log2_64( value );
+	if ( exponent > LATENCY_MAX_EXPONENT ) return INPUT_LATENCY_BUCKETS - 1;
+
+	return ( exponent - LATENCY_SUB_BITS + 1 ) * LATENCY_SUB_COUNT +
+		   (uint32)( ( value >> ( exponent - LATENCY_SUB_BITS ) ) & ( LATENCY_SUB_COUNT - 1 ) );
+}
+
+uint64 input_get_latency_bucket_value( uint32 bucket )
+{
+	uint32 exponent;
+
+	if ( bucket >= INPUT_LATENCY_BUCKETS ) return 0;
+	if ( bucket < LATENCY_SUB_COUNT ) return bucket;
+
+	exponent = bucket / LATENCY_SUB_COUNT + LATENCY_SUB_BITS - 1;
+
+	return (uint64)( LATENCY_SUB_COUNT + bucket % LATENCY_SUB_COUNT ) << ( exponent - LATENCY_SUB_BITS );
+}
+
+static void input_latency_add( InputLatencyHistogram* histogram, uint64 value )
+{
+	if ( histogram->count == 0 || value < histogram->min ) histogram->min = value;
+	if ( value > histogram->max ) histogram->max = value;
+
+	histogram->count++;
+	histogram->total += value;
+	histogram->buckets[input_latency_bucket( value )]++;
+}
+
+static uint64 input_latency_percentile( const InputLatencyHistogram* histogram, uint64 permille )
+{
+	uint64 target, seen = 0;
+	uint32 i;
+
+	if ( histogram->count == 0 ) return 0;
+
+	// The smallest value with at least the given share of the samples at or below it
+	target = ( histogram->count * permille + 999 ) / 1000;
+
+	for ( i = 0; i < INPUT_LATENCY_BUCKETS; i++ )
+	{
+		seen += histogram->buckets[i];
+		if ( seen >= target ) break;
+	}
+
+	// Report the upper edge of the bucket, capped to the largest value seen
+	if ( i + 1 < INPUT_LATENCY_BUCKETS && input_get_latency_bucket_value( i + 1 ) - 1 < histogram->max )
+		return input_get_latency_bucket_value( i + 1 ) - 1;
+
+	return histogram->max;
+}
+
+static void input_latency_finish( InputLatencyHistogram* histogram )
+{
+	histogram->p50 = input_latency_percentile( histogram, 500 );
+	histogram->p90 = input_latency_percentile( histogram, 900 );
+	histogram->p99 = input_latency_percentile( histogram, 990 );
+	histogram->p999 = input_latency_percentile( histogram, 999 );
+}
+
+void input_enable_latency_stats( bool enable )
+{
+	latency_enabled = enable;
+}
+
+bool input_latency_is_enabled( void )
+{
+	// Only the events of the default context are measured
+	return latency_enabled && input_is_default_context();
+}
+
+void input_latency_record( INPUT_EVENT type, uint64 event_time, uint64 start, uint64 end )
+{
+	if ( type >= NUM_INPUT_EVENTS ) return;
+
+	// Events without a time can't tell how long they waited
+	if ( event_time != 0 )
+		input_latency_add( &latency[type].delay, start > event_time ? start - event_time : 0 );
+
+	input_latency_add( &latency[type].dispatch, end > start ? end - start : 0 );
+}
+
+bool input_get_latency_stats( INPUT_EVENT type, InputLatencyStats* stats )
+{
+	if ( stats == NULL || type >= NUM_INPUT_EVENTS ) return false;
+
+	*stats = latency[type];
+
+	input_latency_finish( &stats->delay );
+	input_latency_finish( &stats->dispatch );
+
+	return true;
+}
+
+void input_reset_latency_stats( void )
+{
+	memset( latency, 0, sizeof(latency) );
+}
+
+void input_latency_shutdown( void )
+{
+	latency_enabled = false;
+	input_reset_latency_stats();
+}
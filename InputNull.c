@@ -0,0 +1,136 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputNull.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Headless backend without a window system, for
+ *				driving the library with injected events.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#ifdef INPUT_HEADLESS
+
+#include "InputSys.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// --------------------------------------------------
+
+// The headless backend has no window, input_initialize only requires the window
+// to be non-NULL. input_process takes InputEvent structs instead of window system
+// events and passes them through the same paths as the injection functions.
+
+#ifdef _WIN32
+static LARGE_INTEGER counter_frequency;
+#endif
+
+// --------------------------------------------------
+
+void input_platform_initialize( void* window )
+{
+	UNREFERENCED_PARAM( window );
+
+#ifdef _WIN32
+	QueryPerformanceFrequency( &counter_frequency );
+#endif
+}
+
+void input_platform_shutdown( void )
+{
+}
+
+uint64 input_platform_get_time( void )
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+
+	QueryPerformanceCounter( &counter );
+
+	return (uint64)( counter.QuadPart / counter_frequency.QuadPart ) * 1000000000 +
+		   (uint64)( counter.QuadPart % counter_frequency.QuadPart ) * 1000000000 / counter_frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64)ts.tv_sec * 1000000000 + (uint64)ts.tv_nsec;
+#endif
+}
+
+uint32 input_platform_get_key_code( uint32 key )
+{
+	// Keys are used as key codes as is, larger keys are not tracked in the key bitmap
+	return key < INPUT_KEY_STATE_SIZE ? key : INPUT_KEY_CODE_NONE;
+}
+
+bool input_platform_set_relative_mouse( bool enable )
+{
+	// There is no cursor to confine, relative motion is injected directly
+	UNREFERENCED_PARAM( enable );
+	return true;
+}
+
+void input_enable_hook( bool enable )
+{
+	UNREFERENCED_PARAM( enable );
+}
+
+bool input_process( void* data )
+{
+	InputEvent* event = (InputEvent*)data;
+
+	if ( event == NULL ) return true;
+
+	switch ( event->type )
+	{
+	case INPUT_CHARACTER:
+		return input_inject_char( event->keyboard.key );
+
+	case INPUT_KEY_DOWN:
+		return input_inject_key( event->keyboard.key, true );
+
+	case INPUT_KEY_UP:
+		return input_inject_key( event->keyboard.key, false );
+
+	case INPUT_MOUSE_RELATIVE:
+		return input_inject_relative( event->relative.dx, event->relative.dy );
+
+	default:
+		return input_inject_mouse_event( event->type, event->mouse.x, event->mouse.y,
+										 (MOUSEBTN)event->mouse.button, (MOUSEWHEEL)event->mouse.wheel );
+	}
+}
+
+void input_show_mouse_cursor( bool show )
+{
+	input_context_state()->show_cursor = show;
+}
+
+void input_show_mouse_cursor_ref( bool show )
+{
+	InputContextState* state = input_context_state();
+
+	if ( !show )
+	{
+		if ( state->cursor_refs && --state->cursor_refs == 0 ) state->show_cursor = false;
+	}
+	else
+	{
+		if ( state->cursor_refs++ == 0 ) state->show_cursor = true;
+	}
+}
+
+void input_set_cursor_pos( int16 x, int16 y )
+{
+	InputContextState* state = input_context_state();
+
+	state->mouse_x = x;
+	state->mouse_y = y;
+}
+
+#endif /* INPUT_HEADLESS */
@@ -0,0 +1,233 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputPool.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Fixed size object pools for binds and hooks.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "InputAtomic.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// Every object is preceded by a header which survives the object being freed.
+// The generation is odd while the object is allocated and even while it is free.
+typedef struct {
+	uint32			index;			// Position of the object within the pool
+	volatile uint32	generation;		// Incremented on every allocation and release
+} PoolObjectHeader;
+
+// Allocation and release are serialized with a spin lock, but lookups may run at the
+// same time on the thread dispatching the events. Slabs are never moved, and the array
+// pointing to them is replaced with a larger copy instead of being reallocated in
+// place, so a reader always sees a valid array. Replaced arrays are kept until the
+// pool is destroyed; their total size is less than the size of the current array.
+// The first pointer of an array links it to the previously retired arrays.
+
+// Freed objects are linked through their first bytes
+typedef struct PoolFreeObject {
+	struct PoolFreeObject* next;
+} PoolFreeObject;
+
+#define POOL_HEADER( object ) ( (PoolObjectHeader*)( (uint8*)(object) - sizeof(PoolObjectHeader) ) )
+
+// --------------------------------------------------
+
+void input_pool_create( InputPool* pool, size_t size )
+{
+	memset( pool, 0, sizeof(*pool) );
+
+	// Round the object size up so every object in a slab stays pointer aligned
+	if ( size < sizeof(PoolFreeObject) ) size = sizeof(PoolFreeObject);
+	pool->size = ( size + sizeof(void*) - 1 ) & ~( sizeof(void*) - 1 );
+	pool->stride = pool->size + sizeof(PoolObjectHeader);
+}
+
+void input_pool_destroy( InputPool* pool )
+{
+	void *array, *next;
+	uint32 i;
+
+	// Everything allocated from the pool is released in bulk along with the slabs
+	for ( i = 0; i < pool->num_slabs; i++ )
+		mem_free( pool->slabs[i] );
+
+	if ( pool->slabs ) mem_free( pool->slabs - 1 );
+
+	for ( array = pool->retired; array != NULL; array = next )
+	{
+		next = *(void**)array;
+		mem_free( array );
+	}
+
+	memset( pool, 0, sizeof(*pool) );
+}
+
+static bool input_pool_add_slab( InputPool* pool )
+{
+	PoolFreeObject* object;
+	PoolObjectHeader* header;
+	uint8 **slabs, *slab;
+	uint32 max_slabs, i;
+
+	if ( pool->capacity + INPUT_POOL_SLAB_OBJECTS > INPUT_POOL_MAX_OBJECTS ) return false;
+
+	if ( pool->num_slabs == pool->max_slabs )
+	{
+		max_slabs = pool->max_slabs ? pool->max_slabs << 1 : 8;
+		slabs = mem_alloc( ( max_slabs + 1 ) * sizeof(*slabs) );
+
+		if ( slabs == NULL ) return false;
+
+		slabs++;
+
+		if ( pool->slabs )
+		{
+			memcpy( slabs, pool->slabs, pool->num_slabs * sizeof(*slabs) );
+
+			// The old array may still be read by a lookup
+			*(void**)( pool->slabs - 1 ) = pool->retired;
+			pool->retired = pool->slabs - 1;
+		}
+
+		input_atomic_store_ptr( &pool->slabs, slabs );
+		pool->max_slabs = max_slabs;
+	}
+
+	slab = mem_alloc( INPUT_POOL_SLAB_OBJECTS * pool->stride );
+	if ( slab == NULL ) return false;
+
+	// Push the objects in reverse so they are handed out in address order
+	for ( i = INPUT_POOL_SLAB_OBJECTS; i--; )
+	{
+		header = (PoolObjectHeader*)( slab + i * pool->stride );
+		header->index = pool->capacity + i;
+		header->generation = 0;
+
+		object = (PoolFreeObject*)( header + 1 );
+		object->next = pool->free_list;
+		pool->free_list = object;
+	}
+
+	// The slab has to be in the array before lookups can see the new capacity
+	pool->slabs[pool->num_slabs++] = slab;
+	input_atomic_store( &pool->capacity, pool->capacity + INPUT_POOL_SLAB_OBJECTS );
+
+	return true;
+}
+
+void* input_pool_alloc( InputPool* pool )
+{
+	PoolFreeObject* object;
+	PoolObjectHeader* header;
+
+	input_spin_lock( &pool->lock );
+
+	if ( pool->free_list == NULL && !input_pool_add_slab( pool ) )
+	{
+		input_spin_unlock( &pool->lock );
+		return NULL;
+	}
+
+	object = pool->free_list;
+	pool->free_list = object->next;
+	pool->used++;
+
+	// The object is cleared before the generation marks it allocated
+	memset( object, 0, pool->size );
+
+	header = POOL_HEADER( object );
+	input_atomic_store( &header->generation, header->generation + 1 );
+
+	input_spin_unlock( &pool->lock );
+
+	return object;
+}
+
+void input_pool_free( InputPool* pool, void* ptr )
+{
+	PoolFreeObject* object = ptr;
+	PoolObjectHeader* header;
+
+	if ( object == NULL ) return;
+
+	header = POOL_HEADER( object );
+
+	input_spin_lock( &pool->lock );
+
+	// Bumping the generation invalidates all handles to the object
+	input_atomic_store( &header->generation, header->generation + 1 );
+
+	object->next = pool->free_list;
+	pool->free_list = object;
+	pool->used--;
+
+	input_spin_unlock( &pool->lock );
+}
+
+void input_pool_get_stats( const InputPool* pool, InputPoolStats* stats )
+{
+	stats->object_size = (uint32)pool->size;
+	stats->used = pool->used;
+	stats->capacity = pool->capacity;
+	stats->slabs = pool->num_slabs;
+	stats->bytes = pool->num_slabs * INPUT_POOL_SLAB_OBJECTS * (uint32)pool->stride;
+}
+
+uint32 input_pool_handle( const void* object )
+{
+	const PoolObjectHeader* header;
+
+	if ( object == NULL ) return 0;
+
+	header = POOL_HEADER( object );
+
+	return ( ( ( input_atomic_load( &header->generation ) >> 1 ) & INPUT_POOL_GENERATION_MASK ) << INPUT_POOL_INDEX_BITS ) | header->index;
+}
+
+static PoolObjectHeader* input_pool_header( const InputPool* pool, uint32 index )
+{
+	uint8** slabs;
+
+	if ( index >= input_atomic_load( &pool->capacity ) ) return NULL;
+
+	slabs = input_atomic_load_ptr( &pool->slabs );
+
+	return (PoolObjectHeader*)( slabs[index / INPUT_POOL_SLAB_OBJECTS] + ( index % INPUT_POOL_SLAB_OBJECTS ) * pool->stride );
+}
+
+void* input_pool_at( const InputPool* pool, uint32 index )
+{
+	PoolObjectHeader* header;
+
+	header = input_pool_header( pool, index );
+	if ( header == NULL ) return NULL;
+
+	return ( input_atomic_load( &header->generation ) & 1 ) ? header + 1 : NULL;
+}
+
+void* input_pool_lookup( const InputPool* pool, uint32 handle )
+{
+	PoolObjectHeader* header;
+	uint32 index, generation, current;
+
+	index = handle & ( INPUT_POOL_MAX_OBJECTS - 1 );
+	generation = ( handle >> INPUT_POOL_INDEX_BITS ) & INPUT_POOL_GENERATION_MASK;
+
+	header = input_pool_header( pool, index );
+	if ( header == NULL ) return NULL;
+
+	current = input_atomic_load( &header->generation );
+
+	// The object has to be allocated and from the same generation as the handle
+	if ( ( current & 1 ) == 0 ) return NULL;
+	if ( ( ( current >> 1 ) & INPUT_POOL_GENERATION_MASK ) != generation ) return NULL;
+
+	return header + 1;
+}
@@ -0,0 +1,245 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputQueue.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Lock-free single producer, single consumer event queue
+ *				between the thread capturing input and the thread
+ *				dispatching it.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "InputAtomic.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// The queue of the current context, see InputQueue in InputSys.h
+#define input_get_queue() ( &input_context_state()->queue )
+
+// Ownership of the motion merged while the queue was full. The producer merges into it,
+// the consumer takes it once it has drained the ring.
+#define MOTION_EMPTY	0
+#define MOTION_READY	1	// Holds a merged event no one is touching
+#define MOTION_WRITING	2	// Producer is merging or pushing it
+#define MOTION_READING	3	// Consumer is copying it out
+
+// --------------------------------------------------
+
+bool input_enable_queue( uint32 capacity, INPUT_QUEUE_POLICY policy )
+{
+	InputQueue* queue = input_get_queue();
+	InputEventRecord* records;
+	uint32 size;
+
+	if ( capacity == 0 || capacity > 0x80000000 ) return false;
+
+	for ( size = 2; size < capacity; size <<= 1 ) {}
+
+	records = mem_alloc( size * sizeof(*records) );
+	if ( records == NULL ) return false;
+
+	input_disable_queue();
+
+	queue->records = records;
+	queue->mask = size - 1;
+	queue->policy = policy;
+	queue->enabled = true;
+
+	return true;
+}
+
+void input_disable_queue( void )
+{
+	InputQueue* queue = input_get_queue();
+
+	// Events still in the queue are discarded
+	if ( queue->records ) mem_free( queue->records );
+
+	memset( queue, 0, sizeof(*queue) );
+}
+
+void input_queue_shutdown( void )
+{
+	input_disable_queue();
+}
+
+bool input_queue_is_enabled( void )
+{
+	return input_get_queue()->enabled;
+}
+
+static bool input_queue_push( InputQueue* queue, const InputEventRecord* record )
+{
+	uint32 head, used;
+
+	head = queue->head;
+	used = head - input_atomic_load( &queue->tail );
+
+	if ( used > queue->mask ) return false;
+
+	queue->records[head & queue->mask] = *record;
+	input_atomic_store( &queue->head, head + 1 );
+
+	if ( used + 1 > queue->peak ) input_atomic_store( &queue->peak, used + 1 );
+
+	return true;
+}
+
+static bool input_queue_is_motion( const InputEventRecord* record )
+{
+	return record->event.type == INPUT_MOUSE_MOVE || record->event.type == INPUT_MOUSE_RELATIVE;
+}
+
+static bool input_queue_claim_motion( InputQueue* queue )
+{
+	for ( ;; )
+	{
+		if ( input_atomic_cas( &queue->motion_state, MOTION_READY, MOTION_WRITING ) )
+			return true;
+
+		// Only the consumer moves the motion out of ready, wait until it has copied it
+		if ( input_atomic_load( &queue->motion_state ) == MOTION_EMPTY )
+			return false;
+	}
+}
+
+void input_queue_post( const InputEventRecord* record )
+{
+	InputQueue* queue = input_get_queue();
+	bool has_motion;
+	float dx, dy;
+
+	input_atomic_store( &queue->posted, queue->posted + 1 );
+
+	// A motion event merged while the queue was full goes in before anything else.
+	// Nothing else enters the ring while it is pending so the consumer can take it
+	// once the ring is empty.
+	has_motion = input_queue_claim_motion( queue );
+
+	if ( has_motion && input_queue_push( queue, &queue->motion ) )
+		has_motion = false;
+
+	if ( !has_motion && input_queue_push( queue, record ) )
+	{
+		input_atomic_store( &queue->motion_state, MOTION_EMPTY );
+		return;
+	}
+
+	// The queue is full. Motion is merged into a single event holding the last position,
+	// the deltas are calculated on dispatch so they still add up to the full movement.
+	// Relative motion carries its own deltas, they are summed here instead.
+	if ( queue->policy == INPUT_QUEUE_COALESCE && input_queue_is_motion( record ) &&
+		 ( !has_motion || queue->motion.event.type == record->event.type ) )
+	{
+		if ( !has_motion )
+		{
+			queue->motion = *record;
+			input_atomic_store( &queue->motion_state, MOTION_READY );
+
+			return;
+		}
+
+		input_atomic_store( &queue->coalesced, queue->coalesced + 1 );
+
+		if ( record->event.type == INPUT_MOUSE_RELATIVE )
+		{
+			dx = queue->motion.event.relative.dx + record->event.relative.dx;
+			dy = queue->motion.event.relative.dy + record->event.relative.dy;
+
+			queue->motion = *record;
+			queue->motion.event.relative.dx = dx;
+			queue->motion.event.relative.dy = dy;
+		}
+		else
+		{
+			queue->motion = *record;
+		}
+
+		input_atomic_store( &queue->motion_state, MOTION_READY );
+		return;
+	}
+
+	input_atomic_store( &queue->dropped, queue->dropped + 1 );
+	input_atomic_store( &queue->motion_state, has_motion ? MOTION_READY : MOTION_EMPTY );
+}
+
+uint32 input_dispatch_pending( void )
+{
+	InputQueue* queue = input_get_queue();
+	InputEventRecord record;
+	uint32 tail, count = 0;
+
+	// Events dispatched from within a handler would be out of order
+	if ( !queue->enabled || queue->dispatching ) return 0;
+
+	// The thread draining the queue owns the hooks and binds, the one calling
+	// input_process has to post its changes
+	input_set_dispatch_thread();
+
+	queue->dispatching = true;
+
+	for ( ;; )
+	{
+		tail = queue->tail;
+
+		if ( tail != input_atomic_load( &queue->head ) )
+		{
+			// Copy the event out and release the slot before dispatching it
+			record = queue->records[tail & queue->mask];
+			input_atomic_store( &queue->tail, tail + 1 );
+		}
+		else if ( input_atomic_cas( &queue->motion_state, MOTION_READY, MOTION_READING ) )
+		{
+			// The producer may have filled the ring again before the motion was claimed,
+			// it cannot push more while the motion is being read.
+			if ( tail != input_atomic_load( &queue->head ) )
+			{
+				input_atomic_store( &queue->motion_state, MOTION_READY );
+				continue;
+			}
+
+			// The ring is empty, take the motion merged while it was full
+			record = queue->motion;
+			input_atomic_store( &queue->motion_state, MOTION_EMPTY );
+		}
+		else
+		{
+			break;
+		}
+
+		input_dispatch_record( &record );
+		count++;
+
+		// A handler may have disabled the queue
+		if ( !queue->enabled ) return count;
+	}
+
+	queue->dispatching = false;
+
+	// Draining the queue ends the frame
+	input_flush_motion();
+
+	return count;
+}
+
+void input_get_queue_stats( InputQueueStats* stats )
+{
+	InputQueue* queue = input_get_queue();
+	uint32 head;
+
+	if ( stats == NULL ) return;
+
+	head = input_atomic_load( &queue->head );
+
+	stats->capacity = queue->enabled ? queue->mask + 1 : 0;
+	stats->queued = head - input_atomic_load( &queue->tail );
+	stats->peak = input_atomic_load( &queue->peak );
+	stats->posted = input_atomic_load( &queue->posted );
+	stats->dropped = input_atomic_load( &queue->dropped );
+	stats->coalesced = input_atomic_load( &queue->coalesced );
+}
@@ -0,0 +1,246 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputSequence.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Aho-Corasick automaton for matching key sequences.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// The automaton is a trie of all the patterns with a failure link per state. The
+// failure link points to the state of the longest proper suffix of the current input
+// which is also a prefix of some pattern, so the automaton never has to back up in
+// the input. Since keys come from an unbounded alphabet (X11 keysyms), trie edges
+// are kept in a single hash table keyed on the source state and the key stroke.
+
+static uint32 input_automaton_hash( uint32 state, uint32 key, uint32 modifiers )
+{
+	uint32 hash;
+
+	hash = key ^ ( modifiers * 0x9E3779B9 ) ^ ( state * 0x85EBCA6B );
+	hash ^= hash >> 16;
+	hash *= 0x7FEB352D;
+	hash ^= hash >> 15;
+
+	return hash;
+}
+
+static uint32 input_automaton_goto( const InputSequenceAutomaton* fsm, uint32 state, uint32 key, uint32 modifiers )
+{
+	const InputSequenceEdge* edge;
+	uint32 i;
+
+	if ( fsm->edges == NULL ) return INPUT_SEQUENCE_NONE;
+
+	// The table is never more than half full so an empty slot is always found
+	for ( i = input_automaton_hash( state, key, modifiers ) & fsm->edge_mask; ; i = ( i + 1 ) & fsm->edge_mask )
+	{
+		edge = &fsm->edges[i];
+
+		if ( edge->target == INPUT_SEQUENCE_ROOT ) return INPUT_SEQUENCE_NONE;
+		if ( edge->state == state && edge->key == key && edge->modifiers == modifiers ) return edge->target;
+	}
+}
+
+static void input_automaton_add_edge( InputSequenceAutomaton* fsm, uint32 state, uint32 key, uint32 modifiers, uint32 target )
+{
+	InputSequenceEdge* edge;
+	uint32 i;
+
+	for ( i = input_automaton_hash( state, key, modifiers ) & fsm->edge_mask; ; i = ( i + 1 ) & fsm->edge_mask )
+	{
+		edge = &fsm->edges[i];
+		if ( edge->target == INPUT_SEQUENCE_ROOT ) break;
+	}
+
+	edge->state = state;
+	edge->key = key;
+	edge->modifiers = modifiers;
+	edge->target = target;
+}
+
+void input_automaton_create( InputSequenceAutomaton* fsm )
+{
+	memset( fsm, 0, sizeof(*fsm) );
+}
+
+void input_automaton_destroy( InputSequenceAutomaton* fsm )
+{
+	// State arrays share a single allocation
+	if ( fsm->fail ) mem_free( fsm->fail );
+	if ( fsm->out_id ) mem_free( fsm->out_id );
+	if ( fsm->edges ) mem_free( fsm->edges );
+
+	memset( fsm, 0, sizeof(*fsm) );
+}
+
+bool input_automaton_build( InputSequenceAutomaton* fsm, const InputSequencePattern* patterns, uint32 count )
+{
+	const InputSequencePattern* pattern;
+	InputKeyStroke* labels;
+	uint32 *child, *sibling, *queue, *temp;
+	uint32 total, max_states, edge_size;
+	uint32 i, j, state, next, fail, head, tail;
+
+	input_automaton_destroy( fsm );
+
+	if ( count == 0 ) return true;
+
+	for ( i = 0, total = 0; i < count; i++ )
+		total += patterns[i].length;
+
+	max_states = total + 1;
+
+	for ( edge_size = 16; edge_size < 2 * total; edge_size <<= 1 ) {}
+
+	fsm->fail = mem_alloc( 3 * max_states * sizeof(uint32) );
+	fsm->out_id = mem_alloc( 2 * count * sizeof(uint32) );
+	fsm->edges = mem_alloc_clean( edge_size * sizeof(InputSequenceEdge) );
+
+	// Temporary arrays for building the trie and walking it breadth first
+	temp = mem_alloc( 3 * max_states * sizeof(uint32) + max_states * sizeof(InputKeyStroke) );
+
+	if ( fsm->fail == NULL || fsm->out_id == NULL || fsm->edges == NULL || temp == NULL )
+	{
+		if ( temp ) mem_free( temp );
+		input_automaton_destroy( fsm );
+		return false;
+	}
+
+	fsm->dict = fsm->fail + max_states;
+	fsm->output = fsm->dict + max_states;
+	fsm->out_next = fsm->out_id + count;
+	fsm->edge_mask = edge_size - 1;
+	fsm->num_states = 1;
+
+	child = temp;
+	sibling = child + max_states;
+	queue = sibling + max_states;
+	labels = (InputKeyStroke*)( queue + max_states );
+
+	memset( fsm->output, 0xFF, max_states * sizeof(uint32) );
+	memset( child, 0xFF, max_states * sizeof(uint32) );
+
+	// Insert the patterns into the trie. Outputs are prepended to the state so the
+	// patterns are added in reverse to keep the outputs in the given order.
+	for ( i = count; i--; )
+	{
+		pattern = &patterns[i];
+		state = INPUT_SEQUENCE_ROOT;
+
+		for ( j = 0; j < pattern->length; j++ )
+		{
+			next = input_automaton_goto( fsm, state, pattern->keys[j].key, pattern->keys[j].modifiers );
+
+			if ( next == INPUT_SEQUENCE_NONE )
+			{
+				next = fsm->num_states++;
+
+				input_automaton_add_edge( fsm, state, pattern->keys[j].key, pattern->keys[j].modifiers, next );
+
+				labels[next] = pattern->keys[j];
+				sibling[next] = child[state];
+				child[state] = next;
+			}
+
+			state = next;
+		}
+
+		fsm->out_id[i] = pattern->id;
+		fsm->out_next[i] = fsm->output[state];
+		fsm->output[state] = i;
+	}
+
+	// Resolve the failure and dictionary links breadth first, the links of a state
+	// always point to a shallower state which has already been processed.
+	fsm->fail[INPUT_SEQUENCE_ROOT] = INPUT_SEQUENCE_ROOT;
+	fsm->dict[INPUT_SEQUENCE_ROOT] = INPUT_SEQUENCE_NONE;
+
+	head = tail = 0;
+	queue[tail++] = INPUT_SEQUENCE_ROOT;
+
+	while ( head < tail )
+	{
+		state = queue[head++];
+
+		for ( next = child[state]; next != INPUT_SEQUENCE_NONE; next = sibling[next] )
+		{
+			fail = INPUT_SEQUENCE_ROOT;
+
+			if ( state != INPUT_SEQUENCE_ROOT )
+			{
+				fail = fsm->fail[state];
+
+				while ( fail != INPUT_SEQUENCE_ROOT &&
+						input_automaton_goto( fsm, fail, labels[next].key, labels[next].modifiers ) == INPUT_SEQUENCE_NONE )
+				{
+					fail = fsm->fail[fail];
+				}
+
+				fail = input_automaton_goto( fsm, fail, labels[next].key, labels[next].modifiers );
+				if ( fail == INPUT_SEQUENCE_NONE ) fail = INPUT_SEQUENCE_ROOT;
+			}
+
+			fsm->fail[next] = fail;
+			fsm->dict[next] = fsm->output[fail] != INPUT_SEQUENCE_NONE ? fail : fsm->dict[fail];
+
+			queue[tail++] = next;
+		}
+	}
+
+	mem_free( temp );
+
+	return true;
+}
+
+uint32 input_automaton_step( InputSequenceAutomaton* fsm, uint32 key, uint32 modifiers, uint32 time )
+{
+	uint32 state, next;
+
+	fsm->times[fsm->num_keys++ % INPUT_MAX_SEQUENCE_LENGTH] = time;
+
+	state = fsm->state;
+
+	// Follow the failure links until the key extends a prefix. Each failure link
+	// shortens the matched prefix so this is amortized constant time per key.
+	while ( ( next = input_automaton_goto( fsm, state, key, modifiers ) ) == INPUT_SEQUENCE_NONE )
+	{
+		if ( state == INPUT_SEQUENCE_ROOT )
+		{
+			next = INPUT_SEQUENCE_ROOT;
+			break;
+		}
+
+		state = fsm->fail[state];
+	}
+
+	fsm->state = next;
+	return next;
+}
+
+bool input_automaton_in_time( const InputSequenceAutomaton* fsm, uint32 length, uint32 timeout )
+{
+	uint32 i, newer, older;
+
+	if ( timeout == 0 ) return true;
+	if ( length > fsm->num_keys ) return false;
+
+	// Check the gaps between the last keys stepped through the automaton
+	for ( i = 1; i < length; i++ )
+	{
+		newer = fsm->times[( fsm->num_keys - i ) % INPUT_MAX_SEQUENCE_LENGTH];
+		older = fsm->times[( fsm->num_keys - i - 1 ) % INPUT_MAX_SEQUENCE_LENGTH];
+
+		if ( newer - older > timeout ) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,174 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputSimd.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Vectorized point-in-rectangle tests for mouse binds.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define INPUT_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(INPUT_SIMD_X86) && !defined(_MSC_VER)
+#define INPUT_TARGET(x) __attribute__((target(x)))
+#else
+#define INPUT_TARGET(x)
+#endif
+
+// --------------------------------------------------
+
+input_hit_test_t input_hit_test = input_hit_test_scalar;
+
+// The hit test is shared by every context, it is selected once by whichever context
+// initializes first and the others wait until it has been written
+#define HIT_TEST_NONE			0
+#define HIT_TEST_SELECTING		1
+#define HIT_TEST_READY			2
+
+static volatile uint32 hit_test_state = HIT_TEST_NONE;
+
+// --------------------------------------------------
+
+uint32 input_hit_test_scalar( const InputBounds* bounds, uint32 start, int16 x, int16 y )
+{
+	uint32 i, mask = 0;
+	const int16 *x0, *y0, *x1, *y1;
+
+	x0 = bounds->x0 + start;
+	y0 = bounds->y0 + start;
+	x1 = bounds->x1 + start;
+	y1 = bounds->y1 + start;
+
+	for ( i = 0; i < INPUT_HIT_BATCH; i++ )
+	{
+		if ( x >= x0[i] && x <= x1[i] && y >= y0[i] && y <= y1[i] )
+			mask |= 1u << i;
+	}
+
+	return mask;
+}
+
+#ifdef INPUT_SIMD_X86
+
+INPUT_TARGET("sse2")
+uint32 input_hit_test_sse2( const InputBounds* bounds, uint32 start, int16 x, int16 y )
+{
+	__m128i px, py, miss, lo, hi;
+	uint32 i, mask = 0;
+
+	px = _mm_set1_epi16( x );
+	py = _mm_set1_epi16( y );
+
+	// Two registers of eight binds are packed together per round, giving 16 binds per movemask
+	for ( i = 0; i < INPUT_HIT_BATCH; i += 16 )
+	{
+		miss = _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( bounds->x0 + start + i ) ), px );
+		miss = _mm_or_si128( miss, _mm_cmpgt_epi16( px, _mm_loadu_si128( (const __m128i*)( bounds->x1 + start + i ) ) ) );
+		miss = _mm_or_si128( miss, _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( bounds->y0 + start + i ) ), py ) );
+		lo = _mm_or_si128( miss, _mm_cmpgt_epi16( py, _mm_loadu_si128( (const __m128i*)( bounds->y1 + start + i ) ) ) );
+
+		miss = _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( bounds->x0 + start + i + 8 ) ), px );
+		miss = _mm_or_si128( miss, _mm_cmpgt_epi16( px, _mm_loadu_si128( (const __m128i*)( bounds->x1 + start + i + 8 ) ) ) );
+		miss = _mm_or_si128( miss, _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( bounds->y0 + start + i + 8 ) ), py ) );
+		hi = _mm_or_si128( miss, _mm_cmpgt_epi16( py, _mm_loadu_si128( (const __m128i*)( bounds->y1 + start + i + 8 ) ) ) );
+
+		mask |= ( ~(uint32)_mm_movemask_epi8( _mm_packs_epi16( lo, hi ) ) & 0xFFFF ) << i;
+	}
+
+	return mask;
+}
+
+INPUT_TARGET("avx2")
+uint32 input_hit_test_avx2( const InputBounds* bounds, uint32 start, int16 x, int16 y )
+{
+	__m256i px, py, miss, lo, hi, packed;
+
+	px = _mm256_set1_epi16( x );
+	py = _mm256_set1_epi16( y );
+
+	miss = _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( bounds->x0 + start ) ), px );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( px, _mm256_loadu_si256( (const __m256i*)( bounds->x1 + start ) ) ) );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( bounds->y0 + start ) ), py ) );
+	lo = _mm256_or_si256( miss, _mm256_cmpgt_epi16( py, _mm256_loadu_si256( (const __m256i*)( bounds->y1 + start ) ) ) );
+
+	miss = _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( bounds->x0 + start + 16 ) ), px );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( px, _mm256_loadu_si256( (const __m256i*)( bounds->x1 + start + 16 ) ) ) );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( bounds->y0 + start + 16 ) ), py ) );
+	hi = _mm256_or_si256( miss, _mm256_cmpgt_epi16( py, _mm256_loadu_si256( (const __m256i*)( bounds->y1 + start + 16 ) ) ) );
+
+	// Packing works within 128-bit lanes, restore the bind order before extracting the mask
+	packed = _mm256_permute4x64_epi64( _mm256_packs_epi16( lo, hi ), 0xD8 );
+
+	return ~(uint32)_mm256_movemask_epi8( packed );
+}
+
+static bool input_cpu_has_avx2( void )
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid( info, 0 );
+	if ( info[0] < 7 ) return false;
+
+	// The OS has to save the YMM registers as well
+	__cpuid( info, 1 );
+	if ( ( info[2] & ( 1 << 27 ) ) == 0 ) return false;
+	if ( ( _xgetbv( 0 ) & 6 ) != 6 ) return false;
+
+	__cpuidex( info, 7, 0 );
+	return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+}
+
+static bool input_cpu_has_sse2( void )
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+
+	__cpuid( info, 1 );
+	return ( info[3] & ( 1 << 26 ) ) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "sse2" ) != 0;
+#endif
+}
+
+#endif /* INPUT_SIMD_X86 */
+
+void input_hit_test_initialize( void )
+{
+	input_hit_test_t test = input_hit_test_scalar;
+
+	if ( !input_atomic_cas( &hit_test_state, HIT_TEST_NONE, HIT_TEST_SELECTING ) )
+	{
+		while ( input_atomic_load( &hit_test_state ) != HIT_TEST_READY ) {}
+		return;
+	}
+
+#ifdef INPUT_SIMD_X86
+	if ( input_cpu_has_avx2() )
+		test = input_hit_test_avx2;
+
+	else if ( input_cpu_has_sse2() )
+		test = input_hit_test_sse2;
+#endif
+
+	input_hit_test = test;
+	input_atomic_store( &hit_test_state, HIT_TEST_READY );
+}
@@ -0,0 +1,276 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputState.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Pressed key bitmap and per-frame input snapshots.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "InputAtomic.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+// The key bitmap and the accumulators of the current context, see InputKeyState
+#define input_key_state() ( &input_context_state()->keys )
+
+// --------------------------------------------------
+
+void input_state_reset( void )
+{
+	InputKeyState* state = input_key_state();
+
+	input_spin_lock( &state->frame_lock );
+
+	memset( (void*)state->down, 0, sizeof(state->down) );
+	memset( state->pressed, 0, sizeof(state->pressed) );
+	memset( state->released, 0, sizeof(state->released) );
+
+	state->x = state->y = 0;
+	state->dx = state->dy = 0;
+	state->wheel = 0;
+	state->buttons = state->buttons_pressed = state->buttons_released = 0;
+	state->raw_dx = state->raw_dy = 0;
+
+	memset( &state->frame, 0, sizeof(state->frame) );
+
+	input_spin_unlock( &state->frame_lock );
+}
+
+void input_set_key_state( uint32 code, bool down )
+{
+	InputKeyState* state;
+	uint32 word, bit, bits;
+
+	if ( code >= INPUT_KEY_STATE_SIZE ) return;
+
+	state = input_key_state();
+	word = code >> 5;
+	bit = 1u << ( code & 31 );
+	bits = state->down[word];
+
+	// Key repeat does not count as a new press
+	if ( down == ( ( bits & bit ) != 0 ) ) return;
+
+	input_spin_lock( &state->frame_lock );
+
+	if ( down ) state->pressed[word] |= bit;
+	else state->released[word] |= bit;
+
+	input_atomic_store( &state->down[word], bits ^ bit );
+
+	input_spin_unlock( &state->frame_lock );
+}
+
+void input_set_key_states( const uint8* keys )
+{
+	InputKeyState* state = input_key_state();
+	uint32 i, word, bits;
+
+	input_spin_lock( &state->frame_lock );
+
+	for ( i = 0; i < INPUT_KEY_STATE_WORDS; i++ )
+	{
+		word = 0;
+
+		if ( keys != NULL )
+		{
+			word = (uint32)keys[i*4] | ( (uint32)keys[i*4+1] << 8 ) |
+				   ( (uint32)keys[i*4+2] << 16 ) | ( (uint32)keys[i*4+3] << 24 );
+		}
+
+		// A resync is seen by the frames as presses and releases of the changed keys
+		bits = state->down[i];
+		state->pressed[i] |= word & ~bits;
+		state->released[i] |= bits & ~word;
+
+		input_atomic_store( &state->down[i], word );
+	}
+
+	input_spin_unlock( &state->frame_lock );
+}
+
+void input_state_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	InputKeyState* state = input_key_state();
+	uint32 bit;
+
+	bit = 1u << button;
+
+	input_spin_lock( &state->frame_lock );
+
+	// Windows reports the position of wheel events in screen coordinates
+	if ( type != INPUT_MOUSE_WHEEL )
+	{
+		state->dx += x - state->x;
+		state->dy += y - state->y;
+		state->x = x;
+		state->y = y;
+	}
+
+	switch ( type )
+	{
+	case INPUT_MOUSE_WHEEL:
+		if ( wheel == MWHEEL_UP ) state->wheel++;
+		else if ( wheel == MWHEEL_DOWN ) state->wheel--;
+		break;
+
+	case INPUT_LBUTTON_DOWN:
+	case INPUT_MBUTTON_DOWN:
+	case INPUT_RBUTTON_DOWN:
+		if ( !( state->buttons & bit ) ) state->buttons_pressed |= bit;
+		state->buttons |= bit;
+		break;
+
+	case INPUT_LBUTTON_UP:
+	case INPUT_MBUTTON_UP:
+	case INPUT_RBUTTON_UP:
+		if ( state->buttons & bit ) state->buttons_released |= bit;
+		state->buttons &= ~bit;
+		break;
+
+	default:
+		break;
+	}
+
+	input_spin_unlock( &state->frame_lock );
+}
+
+void input_state_relative_event( float dx, float dy )
+{
+	InputKeyState* state = input_key_state();
+
+	input_spin_lock( &state->frame_lock );
+
+	state->raw_dx += dx;
+	state->raw_dy += dy;
+
+	input_spin_unlock( &state->frame_lock );
+}
+
+uint32 input_key_modifier_mask( uint32 key )
+{
+	// Modifiers are answered from the modifier state. The generic keys match either
+	// side, on X11 the generic keys share their value with the left side keys.
+	if ( key == MKEY_SHIFT ) return INPUT_MOD_SHIFT;
+	if ( key == MKEY_CONTROL ) return INPUT_MOD_CONTROL;
+	if ( key == MKEY_ALT ) return INPUT_MOD_ALT;
+	if ( key == MKEY_LSHIFT ) return INPUT_MOD_LSHIFT;
+	if ( key == MKEY_RSHIFT ) return INPUT_MOD_RSHIFT;
+	if ( key == MKEY_LCONTROL ) return INPUT_MOD_LCONTROL;
+	if ( key == MKEY_RCONTROL ) return INPUT_MOD_RCONTROL;
+	if ( key == MKEY_LALT ) return INPUT_MOD_LALT;
+	if ( key == MKEY_RALT ) return INPUT_MOD_RALT;
+
+	return 0;
+}
+
+static bool input_test_key( const uint32* bits, uint32 key )
+{
+	uint32 code;
+
+	code = input_platform_get_key_code( key );
+	if ( code == INPUT_KEY_CODE_NONE || code >= INPUT_KEY_STATE_SIZE ) return false;
+
+	return ( bits[code >> 5] >> ( code & 31 ) ) & 1;
+}
+
+bool input_get_key_state( uint32 key )
+{
+	uint32 code, mask;
+
+	mask = input_key_modifier_mask( key );
+	if ( mask != 0 ) return ( input_get_modifiers() & mask ) != 0;
+
+	code = input_platform_get_key_code( key );
+	if ( code == INPUT_KEY_CODE_NONE || code >= INPUT_KEY_STATE_SIZE ) return false;
+
+	return ( input_atomic_load( &input_key_state()->down[code >> 5] ) >> ( code & 31 ) ) & 1;
+}
+
+const InputFrame* input_begin_frame( void )
+{
+	InputKeyState* state = input_key_state();
+	InputFrame* frame = &state->frame;
+	uint32 i;
+
+	input_spin_lock( &state->frame_lock );
+
+	for ( i = 0; i < INPUT_KEY_STATE_WORDS; i++ )
+	{
+		frame->keys_down[i] = state->down[i];
+		frame->keys_pressed[i] = state->pressed[i];
+		frame->keys_released[i] = state->released[i];
+
+		state->pressed[i] = 0;
+		state->released[i] = 0;
+	}
+
+	frame->x = state->x;
+	frame->y = state->y;
+	frame->dx = state->dx;
+	frame->dy = state->dy;
+	frame->wheel = state->wheel;
+	frame->buttons = state->buttons;
+	frame->buttons_pressed = state->buttons_pressed;
+	frame->buttons_released = state->buttons_released;
+	frame->raw_dx = state->raw_dx;
+	frame->raw_dy = state->raw_dy;
+
+	state->dx = state->dy = 0;
+	state->raw_dx = state->raw_dy = 0;
+	state->wheel = 0;
+	state->buttons_pressed = state->buttons_released = 0;
+
+	input_spin_unlock( &state->frame_lock );
+
+	frame->modifiers = input_get_modifiers();
+	frame->time = input_platform_get_time();
+
+	return frame;
+}
+
+const InputFrame* input_get_frame( void )
+{
+	return &input_key_state()->frame;
+}
+
+bool input_is_key_down( uint32 key )
+{
+	const InputFrame* frame = input_get_frame();
+	uint32 mask;
+
+	mask = input_key_modifier_mask( key );
+	if ( mask != 0 ) return ( frame->modifiers & mask ) != 0;
+
+	return input_test_key( frame->keys_down, key );
+}
+
+bool input_was_key_pressed( uint32 key )
+{
+	return input_test_key( input_get_frame()->keys_pressed, key );
+}
+
+bool input_was_key_released( uint32 key )
+{
+	return input_test_key( input_get_frame()->keys_released, key );
+}
+
+bool input_is_button_down( MOUSEBTN button )
+{
+	return ( input_get_frame()->buttons >> button ) & 1;
+}
+
+bool input_was_button_pressed( MOUSEBTN button )
+{
+	return ( input_get_frame()->buttons_pressed >> button ) & 1;
+}
+
+bool input_was_button_released( MOUSEBTN button )
+{
+	return ( input_get_frame()->buttons_released >> button ) & 1;
+}
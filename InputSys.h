@@ -14,19 +14,297 @@
 #define __MYLLY_INPUT_SYS_H
 
 #include "Input.h"
+#include "InputAtomic.h"
 
-// Input processing functions used by platform specific implementation
+// Input processing functions used by platform specific implementation. An event is
+// passed to the hooks and then to the binds, or queued when the event queue is enabled.
+// Returns false when the event was consumed.
+bool	input_post_key_event			( INPUT_EVENT type, uint32 key );
+bool	input_post_mouse_event			( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
+bool	input_post_relative_event		( float dx, float dy );
+
+// Older names for input_post_key_event and input_post_mouse_event
 bool	input_handle_keyboard_event		( INPUT_EVENT type, uint32 key );
 bool	input_handle_mouse_event		( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
-bool	input_handle_char_bind			( uint32 key );
-bool	input_handle_key_up_bind		( uint32 key );
-bool	input_handle_key_down_bind		( uint32 key );
-bool	input_handle_mouse_move_bind	( int16 x, int16 y );
-bool	input_handle_mouse_up_bind		( MOUSEBTN button, int16 x, int16 y );
-bool	input_handle_mouse_down_bind	( MOUSEBTN button, int16 x, int16 y );
-
-// Platform specific library initializers
+
+// Injects a mouse event at the given position, see InputInject.c
+bool	input_inject_mouse_event		( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
+
+// Relative mouse mode, the platform implementation hides and confines the cursor and
+// starts reporting raw motion. Returns false if the mode is not supported.
+bool	input_platform_set_relative_mouse	( bool enable );
+
+// A captured event along with the state required to dispatch it later
+typedef struct {
+	InputEvent	event;			// Mouse deltas are filled in when the event is dispatched
+	uint32		modifiers;		// Modifier state when the event was captured
+	bool		modifier_key;	// Is the key of the event a modifier key
+} InputEventRecord;
+
+bool	input_dispatch_record			( const InputEventRecord* record );
+
+// Passes a complete record to the frame snapshot and the queue or the dispatcher,
+// used by the backends through input_post_* and directly by the trace replayer.
+bool	input_submit_record				( const InputEventRecord* record );
+
+// Trace recording, see InputTrace.c
+void	input_trace_write				( const InputEventRecord* record );
+void	input_trace_shutdown			( void );
+
+// Latency histograms, see InputLatency.c
+bool	input_latency_is_enabled		( void );
+void	input_latency_record			( INPUT_EVENT type, uint64 event_time, uint64 start, uint64 end );
+void	input_latency_shutdown			( void );
+
+// Dispatch timeline, see InputTimeline.c
+bool	input_timeline_is_enabled		( void );
+void	input_timeline_event			( const InputEvent* event, uint64 start, uint64 end, bool consumed );
+void	input_timeline_handler			( INPUT_HANDLER_TYPE type, void* handler, INPUT_EVENT event, uint64 start, uint64 end, bool consumed );
+void	input_timeline_shutdown			( void );
+
+// Event queue, see InputQueue.c. The head is only written by the producer (input_process)
+// and the tail only by the consumer (input_dispatch_pending). Both are free running
+// counters, the slot of an event is the counter masked with the capacity. Each side lives
+// on its own cache line.
+typedef struct {
+	InputEventRecord*	records;
+	uint32				mask;			// Capacity - 1, the capacity is a power of two
+	INPUT_QUEUE_POLICY	policy;
+	bool				enabled;
+
+	uint8				pad0[INPUT_CACHE_LINE];
+
+	// Producer side
+	volatile uint32		head;
+	volatile uint32		posted;
+	volatile uint32		dropped;
+	volatile uint32		coalesced;
+	volatile uint32		peak;
+	InputEventRecord	motion;			// Motion merged while the queue was full
+	volatile uint32		motion_state;	// Who owns the merged motion, see InputQueue.c
+
+	uint8				pad1[INPUT_CACHE_LINE];
+
+	// Consumer side
+	volatile uint32		tail;
+	bool				dispatching;
+} InputQueue;
+
+bool	input_queue_is_enabled			( void );
+void	input_queue_post				( const InputEventRecord* record );
+void	input_queue_shutdown			( void );
+
+// Modifier state tracking, the platform implementation reports modifier keys and lock states
+void	input_set_modifiers				( uint32 modifiers, bool set );
+void	input_set_lock_state			( uint32 locks );
+
+// Pressed key bitmap, indexed by platform key codes (X11 keycodes, virtual keys).
+// input_set_key_states takes a full bit vector (bit n of byte n/8), NULL clears it.
+#define INPUT_KEY_STATE_SIZE	256
+#define INPUT_KEY_CODE_NONE		0
+
+void	input_set_key_state				( uint32 code, bool down );
+void	input_set_key_states			( const uint8* keys );
+uint32	input_platform_get_key_code		( uint32 key );
+
+// Key bitmap and frame snapshot accumulators, see InputState.c. The key bitmap is only
+// written by the thread processing input and can be read from any thread without locking.
+// The accumulators collect the changes between two calls to input_begin_frame, they are
+// shared with the thread starting the frames and protected by a spin lock.
+#define INPUT_KEY_STATE_WORDS	( INPUT_KEY_STATE_SIZE / 32 )
+
+typedef struct {
+	volatile uint32	down[INPUT_KEY_STATE_WORDS];		// Currently pressed keys by platform key code
+
+	volatile uint32	frame_lock;
+	uint32			pressed[INPUT_KEY_STATE_WORDS];		// Keys pressed since the last frame
+	uint32			released[INPUT_KEY_STATE_WORDS];	// Keys released since the last frame
+	int16			x, y;								// Last reported mouse position
+	int32			dx, dy;								// Mouse movement since the last frame
+	int32			wheel;								// Wheel steps since the last frame
+	uint32			buttons;							// Currently held mouse buttons
+	uint32			buttons_pressed;
+	uint32			buttons_released;
+	float			raw_dx, raw_dy;						// Relative mode movement since the last frame
+
+	InputFrame		frame;								// Snapshot of the current frame
+} InputKeyState;
+
+void	input_state_reset				( void );
+void	input_state_mouse_event			( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
+void	input_state_relative_event		( float dx, float dy );
+uint32	input_key_modifier_mask			( uint32 key );
+
+// Index of the lowest set bit, the value must be non-zero
+#ifdef _MSC_VER
+#include <intrin.h>
+static __inline uint32 input_ctz32( uint32 value ) { unsigned long idx; _BitScanForward( &idx, value ); return (uint32)idx; }
+#else
+#define input_ctz32( value ) ( (uint32)__builtin_ctz( value ) )
+#endif
+
+// Index of the highest set bit, the value must be non-zero
+#ifdef _MSC_VER
+static __inline uint32 input_log2_64( uint64 value )
+{
+	unsigned long idx;
+
+	if ( value >> 32 ) { _BitScanReverse( &idx, (unsigned long)( value >> 32 ) ); return (uint32)idx + 32; }
+	_BitScanReverse( &idx, (unsigned long)value );
+	return (uint32)idx;
+}
+#else
+#define input_log2_64( value ) ( 63 - (uint32)__builtin_clzll( value ) )
+#endif
+
+// Mouse bind bounds as a structure of arrays, padded to a multiple of INPUT_HIT_BATCH
+// entries. Unused entries are set to an empty rectangle so they never register a hit.
+#define INPUT_HIT_BATCH		32
+
+typedef struct {
+	int16*	x0;
+	int16*	y0;
+	int16*	x1;
+	int16*	y1;
+} InputBounds;
+
+// Tests INPUT_HIT_BATCH bounds starting from the given index, bit n of the result is
+// set when the point is inside bounds[start+n]. The best implementation for the CPU
+// is selected by input_hit_test_initialize.
+typedef uint32	( *input_hit_test_t )			( const InputBounds* bounds, uint32 start, int16 x, int16 y );
+
+extern input_hit_test_t input_hit_test;
+
+void	input_hit_test_initialize		( void );
+uint32	input_hit_test_scalar			( const InputBounds* bounds, uint32 start, int16 x, int16 y );
+uint32	input_hit_test_sse2				( const InputBounds* bounds, uint32 start, int16 x, int16 y );
+uint32	input_hit_test_avx2				( const InputBounds* bounds, uint32 start, int16 x, int16 y );
+
+// Fixed size object pool, see InputPool.c. Objects can be referred to with 30-bit
+// handles made of the object index in the lower bits and its generation above it.
+// Objects may be allocated and freed from any thread, lookups don't take the lock.
+#define INPUT_POOL_SLAB_OBJECTS		256
+#define INPUT_POOL_INDEX_BITS		20
+#define INPUT_POOL_MAX_OBJECTS		( 1u << INPUT_POOL_INDEX_BITS )
+#define INPUT_POOL_GENERATION_MASK	0x3FF
+
+typedef struct {
+	size_t	size;			// Size of a single object
+	size_t	stride;			// Size of a single object including its header
+	uint32	used;			// Objects currently allocated
+	volatile uint32	capacity;	// Objects in all slabs
+	uint32	num_slabs;
+	uint32	max_slabs;
+	uint8** volatile slabs;	// Replaced with a copy when it grows
+	void*	retired;		// Slab arrays which have been replaced
+	void*	free_list;
+	volatile uint32	lock;	// Held while allocating and freeing objects
+} InputPool;
+
+void	input_pool_create				( InputPool* pool, size_t size );
+void	input_pool_destroy				( InputPool* pool );
+void*	input_pool_alloc				( InputPool* pool );
+void	input_pool_free					( InputPool* pool, void* object );
+void	input_pool_get_stats			( const InputPool* pool, InputPoolStats* stats );
+uint32	input_pool_handle				( const void* object );
+void*	input_pool_lookup				( const InputPool* pool, uint32 handle );
+void*	input_pool_at					( const InputPool* pool, uint32 index );		// NULL if the slot is free
+
+// Aho-Corasick automaton over key strokes, used to match all sequence binds at once.
+// See InputSequence.c. States are numbered from the root (0), outputs of a state are
+// linked through out_next and carry the identifier given with the pattern.
+#define INPUT_SEQUENCE_ROOT		0
+#define INPUT_SEQUENCE_NONE		0xFFFFFFFF
+
+typedef struct {
+	const InputKeyStroke*	keys;
+	uint32					length;
+	uint32					id;
+} InputSequencePattern;
+
+typedef struct {
+	uint32	state;			// Source state of the trie edge
+	uint32	key;
+	uint32	modifiers;
+	uint32	target;			// Target state, INPUT_SEQUENCE_ROOT for an empty hash slot
+} InputSequenceEdge;
+
+typedef struct {
+	uint32				state;			// Current state
+	uint32				num_states;
+	uint32*				fail;			// Longest proper suffix of the state which is also a state
+	uint32*				dict;			// Next state in the suffix chain which has outputs
+	uint32*				output;			// First output of the state
+	uint32*				out_id;			// Pattern identifier per output
+	uint32*				out_next;		// Next output of the same state
+	InputSequenceEdge*	edges;			// Trie edges, open-addressed
+	uint32				edge_mask;
+	uint32				num_keys;		// Number of keys stepped, indexes the time ring
+	uint32				times[INPUT_MAX_SEQUENCE_LENGTH];
+} InputSequenceAutomaton;
+
+void	input_automaton_create			( InputSequenceAutomaton* fsm );
+void	input_automaton_destroy			( InputSequenceAutomaton* fsm );
+bool	input_automaton_build			( InputSequenceAutomaton* fsm, const InputSequencePattern* patterns, uint32 count );
+uint32	input_automaton_step			( InputSequenceAutomaton* fsm, uint32 key, uint32 modifiers, uint32 time );
+bool	input_automaton_in_time			( const InputSequenceAutomaton* fsm, uint32 length, uint32 timeout );
+
+// Event timestamps. The platform implementation reports the time of each event
+// before processing it, window system event times are converted with InputClock.c.
+typedef struct {
+	int64	event_base;		// Event clock in milliseconds, extended to 64 bits
+	uint32	last_event;		// Last reported event time
+	uint64	last_local;		// Local time of the last conversion
+	int64	offset;			// Estimated offset from the event clock to the local clock
+	bool	valid;
+} InputClockSync;
+
+void	input_clock_reset				( InputClockSync* sync );
+uint64	input_clock_convert				( InputClockSync* sync, uint32 event_ms, uint64 now );
+
+// Reverse keyboard mapping from keysyms to key codes for the backends which translate
+// key codes themselves, see InputKeyMap.c. Keeps the first key code added for a keysym.
+typedef struct {
+	uint32	keysym;
+	uint32	code;			// INPUT_KEY_CODE_NONE for an empty slot
+} InputKeyMapSlot;
+
+typedef struct {
+	InputKeyMapSlot*	slots;
+	uint32				mask;	// Number of slots minus one
+} InputKeyMap;
+
+bool	input_keymap_create				( InputKeyMap* map, uint32 capacity );
+void	input_keymap_destroy			( InputKeyMap* map );
+void	input_keymap_add				( InputKeyMap* map, uint32 keysym, uint32 code );
+uint32	input_keymap_find				( const InputKeyMap* map, uint32 keysym );
+
+void	input_set_event_time			( uint64 time );
+
+// Nanoseconds from a monotonic clock (CLOCK_MONOTONIC, QueryPerformanceCounter)
+uint64	input_platform_get_time			( void );
+
+// Platform specific library initializers. The backend keeps the state of a context
+// (the window etc.) in InputContextState.platform.
 void	input_platform_initialize		( void* window );
 void	input_platform_shutdown			( void );
 
+// The part of an input context used by the modules outside Input.c. All functions work
+// on the context current on the calling thread (see input_set_context), the default
+// context is current until another one is set.
+typedef struct {
+	InputKeyState	keys;			// Key bitmap and frame snapshots
+	InputQueue		queue;			// Event queue
+	void*			platform;		// Backend state, NULL before input_platform_initialize
+	bool			show_cursor;	// Display mouse cursor
+	uint32			cursor_refs;	// Reference count of input_show_mouse_cursor_ref
+	int16			mouse_x;		// Current mouse coordinates
+	int16			mouse_y;
+	int16			pointer_x;		// Position of the injected pointer, see InputInject.c
+	int16			pointer_y;
+} InputContextState;
+
+InputContextState*	input_context_state	( void );
+bool	input_is_default_context		( void );
+
 #endif /* __MYLLY_INPUT_SYS_H */
@@ -0,0 +1,554 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputTimeline.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Timeline of event dispatches and handler calls,
+ *				exported as Chrome trace JSON or Perfetto traces.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+
+// Every dispatched event and every hook or bind called for it is stored as a slice
+// with a start and an end time. Slices are added when they end, so the handlers of
+// an event are stored before the event itself. The oldest slices are overwritten
+// once the ring is full. All the slices are put on a single track of the process
+// named TIMELINE_TRACK_NAME, times come from input_platform_get_time.
+#define TIMELINE_TRACK_NAME		"Lib-Input"
+#define TIMELINE_TID			0x494E			// Thread id of the track in JSON traces
+#define TIMELINE_TRACK_UUID		0x4C49422D494E	// Track uuid in Perfetto traces
+#define TIMELINE_SEQUENCE_ID	0x494E			// Packet sequence id in Perfetto traces
+#define TIMELINE_NAME_SIZE		64
+
+typedef enum {
+	TIMELINE_EVENT,			// Dispatch of an event
+	TIMELINE_HANDLER,		// Call to a handler, followed by INPUT_HANDLER_TYPE
+} TIMELINE_KIND;
+
+typedef struct {
+	uint64	start;
+	uint64	end;
+	uint64	wait;			// Time from the event to the start of its dispatch, events only
+	void*	handler;		// Called handler, handlers only
+	union {
+		uint32	key;		// Keyboard events
+		int16	pos[2];		// Mouse events
+		float	delta[2];	// Relative mouse events
+	};
+	uint8	kind;
+	uint8	type;			// INPUT_EVENT of the slice
+	uint8	consumed;		// Did the event or the handler stop the dispatch
+} TimelineEntry;
+
+static TimelineEntry* timeline = NULL;			// Ring of recorded slices
+static uint32 timeline_capacity = 0;
+static uint32 timeline_count = 0;
+static uint32 timeline_next = 0;				// Index of the next slice to write
+
+static const char* timeline_event_names[NUM_INPUT_EVENTS] = {
+	"character", "key_up", "key_down", "mouse_move", "mouse_wheel",
+	"lbutton_up", "lbutton_down", "mbutton_up", "mbutton_down",
+	"rbutton_up", "rbutton_down", "mouse_relative"
+};
+
+static const char* timeline_handler_names[] = { "hook", "key bind", "mouse bind" };
+
+// --------------------------------------------------
+
+// Protobuf encoding of the few Perfetto messages the export uses. Field numbers are
+// from protos/perfetto/trace/trace_packet.proto and track_event/*.proto.
+#define PROTO_VARINT			0
+#define PROTO_FIXED64			1
+#define PROTO_BYTES				2
+
+#define TRACE_PACKET			1	// Trace.packet
+
+#define PACKET_TIMESTAMP		8	// TracePacket fields
+#define PACKET_SEQUENCE_ID		10
+#define PACKET_TRACK_EVENT		11
+#define PACKET_SEQUENCE_FLAGS	13
+#define PACKET_CLOCK_ID			58
+#define PACKET_TRACK_DESCRIPTOR	60
+
+#define DESCRIPTOR_UUID			1	// TrackDescriptor fields
+#define DESCRIPTOR_NAME			2
+#define DESCRIPTOR_PROCESS		3
+#define PROCESS_PID				1	// ProcessDescriptor.pid
+
+#define EVENT_ANNOTATIONS		4	// TrackEvent fields
+#define EVENT_TYPE				9
+#define EVENT_TRACK_UUID		11
+#define EVENT_NAME				23
+
+#define ANNOTATION_BOOL			2	// DebugAnnotation fields
+#define ANNOTATION_UINT			3
+#define ANNOTATION_INT			4
+#define ANNOTATION_DOUBLE		5
+#define ANNOTATION_STRING		6
+#define ANNOTATION_NAME			10
+
+#define SLICE_BEGIN				1	// TrackEvent.Type
+#define SLICE_END				2
+
+#define SEQ_INCREMENTAL_STATE_CLEARED	1
+#define SEQ_NEEDS_INCREMENTAL_STATE		2
+
+#define CLOCK_MONOTONIC_ID		3	// BuiltinClock.BUILTIN_CLOCK_MONOTONIC
+
+typedef struct {
+	uint8	data[512];
+	uint32	size;
+	bool	overflow;
+} ProtoBuffer;
+
+// --------------------------------------------------
+
+static void proto_put( ProtoBuffer* buffer, const void* data, uint32 size )
+{
+	if ( buffer->size + size > sizeof(buffer->data) )
+	{
+		buffer->overflow = true;
+		return;
+	}
+
+	memcpy( &buffer->data[buffer->size], data, size );
+	buffer->size += size;
+}
+
+static void proto_varint( ProtoBuffer* buffer, uint64 value )
+{
+	uint8 bytes[10];
+	uint32 size = 0;
+
+	do
+	{
+		bytes[size++] = (uint8)( ( value & 0x7F ) | ( value > 0x7F ? 0x80 : 0 ) );
+		value >>= 7;
+	}
+	while ( value );
+
+	proto_put( buffer, bytes, size );
+}
+
+static void proto_uint( ProtoBuffer* buffer, uint32 field, uint64 value )
+{
+	proto_varint( buffer, field << 3 | PROTO_VARINT );
+	proto_varint( buffer, value );
+}
+
+static void proto_double( ProtoBuffer* buffer, uint32 field, double value )
+{
+	uint8 bytes[8];
+	uint64 bits;
+	uint32 i;
+
+	memcpy( &bits, &value, sizeof(bits) );
+
+	// Fixed size fields are little endian regardless of the platform
+	for ( i = 0; i < 8; i++ )
+		bytes[i] = (uint8)( bits >> ( i * 8 ) );
+
+	proto_varint( buffer, field << 3 | PROTO_FIXED64 );
+	proto_put( buffer, bytes, sizeof(bytes) );
+}
+
+static void proto_bytes( ProtoBuffer* buffer, uint32 field, const void* data, uint32 size )
+{
+	proto_varint( buffer, field << 3 | PROTO_BYTES );
+	proto_varint( buffer, size );
+	proto_put( buffer, data, size );
+}
+
+static void proto_string( ProtoBuffer* buffer, uint32 field, const char* str )
+{
+	proto_bytes( buffer, field, str, (uint32)strlen( str ) );
+}
+
+static void proto_message( ProtoBuffer* buffer, uint32 field, const ProtoBuffer* message )
+{
+	if ( message->overflow ) buffer->overflow = true;
+	proto_bytes( buffer, field, message->data, message->size );
+}
+
+// --------------------------------------------------
+
+void input_enable_timeline( uint32 capacity )
+{
+	if ( timeline ) mem_free( timeline );
+
+	timeline = capacity ? mem_alloc( capacity * sizeof(*timeline) ) : NULL;
+	timeline_capacity = timeline ? capacity : 0;
+	timeline_count = 0;
+	timeline_next = 0;
+}
+
+bool input_timeline_is_enabled( void )
+{
+	// Only the events of the default context are recorded
+	return timeline != NULL && input_is_default_context();
+}
+
+void input_clear_timeline( void )
+{
+	timeline_count = 0;
+	timeline_next = 0;
+}
+
+void input_timeline_shutdown( void )
+{
+	input_enable_timeline( 0 );
+}
+
+static TimelineEntry* input_timeline_add( uint64 start, uint64 end, INPUT_EVENT type, bool consumed )
+{
+	TimelineEntry* entry;
+
+	entry = &timeline[timeline_next];
+
+	if ( ++timeline_next == timeline_capacity ) timeline_next = 0;
+	if ( timeline_count < timeline_capacity ) timeline_count++;
+
+	entry->start = start;
+	entry->end = end;
+	entry->type = (uint8)type;
+	entry->consumed = consumed;
+
+	return entry;
+}
+
+void input_timeline_event( const InputEvent* event, uint64 start, uint64 end, bool consumed )
+{
+	TimelineEntry* entry;
+
+	entry = input_timeline_add( start, end, event->type, consumed );
+
+	entry->kind = TIMELINE_EVENT;
+	entry->handler = NULL;
+	entry->wait = event->time != 0 && start > event->time ? start - event->time : 0;
+
+	switch ( event->type )
+	{
+	case INPUT_CHARACTER:
+	case INPUT_KEY_UP:
+	case INPUT_KEY_DOWN:
+		entry->key = event->keyboard.key;
+		break;
+
+	case INPUT_MOUSE_RELATIVE:
+		entry->delta[0] = event->relative.dx;
+		entry->delta[1] = event->relative.dy;
+		break;
+
+	default:
+		entry->pos[0] = event->mouse.x;
+		entry->pos[1] = event->mouse.y;
+		break;
+	}
+}
+
+void input_timeline_handler( INPUT_HANDLER_TYPE type, void* handler, INPUT_EVENT event, uint64 start, uint64 end, bool consumed )
+{
+	TimelineEntry* entry;
+
+	entry = input_timeline_add( start, end, event, consumed );
+
+	entry->kind = (uint8)( TIMELINE_HANDLER + type );
+	entry->handler = handler;
+	entry->wait = 0;
+	entry->key = 0;
+}
+
+static const TimelineEntry* input_timeline_get( uint32 index )
+{
+	// Index 0 is the oldest slice in the ring
+	index += timeline_capacity + timeline_next - timeline_count;
+	return &timeline[index % timeline_capacity];
+}
+
+static void input_timeline_name( const TimelineEntry* entry, char* name )
+{
+	if ( entry->kind == TIMELINE_EVENT )
+	{
+		strcpy( name, timeline_event_names[entry->type] );
+		return;
+	}
+
+	// Handlers are named by their address, which can be looked up from the symbols
+	sprintf( name, "%s 0x%llx", timeline_handler_names[entry->kind - TIMELINE_HANDLER],
+			 (unsigned long long)(size_t)entry->handler );
+}
+
+static uint32 input_timeline_pid( void )
+{
+#ifdef _WIN32
+	return (uint32)GetCurrentProcessId();
+#else
+	return (uint32)getpid();
+#endif
+}
+
+static bool input_timeline_write_json( FILE* file )
+{
+	const TimelineEntry* entry;
+	char name[TIMELINE_NAME_SIZE];
+	uint32 i, pid;
+
+	pid = input_timeline_pid();
+
+	fprintf( file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+	fprintf( file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			 pid, TIMELINE_TID, TIMELINE_TRACK_NAME );
+
+	for ( i = 0; i < timeline_count; i++ )
+	{
+		entry = input_timeline_get( i );
+		input_timeline_name( entry, name );
+
+		// Times are in microseconds, the fraction keeps the nanoseconds
+		fprintf( file, ",\n{\"ph\":\"X\",\"cat\":\"input\",\"name\":\"%s\",\"pid\":%u,\"tid\":%u,"
+					   "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"consumed\":%s",
+				 name, pid, TIMELINE_TID,
+				 (unsigned long long)( entry->start / 1000 ), (uint32)( entry->start % 1000 ),
+				 (unsigned long long)( ( entry->end - entry->start ) / 1000 ), (uint32)( ( entry->end - entry->start ) % 1000 ),
+				 entry->consumed ? "true" : "false" );
+
+		if ( entry->kind != TIMELINE_EVENT )
+		{
+			fprintf( file, ",\"event\":\"%s\"}}", timeline_event_names[entry->type] );
+			continue;
+		}
+
+		fprintf( file, ",\"wait_ns\":%llu", (unsigned long long)entry->wait );
+
+		switch ( entry->type )
+		{
+		case INPUT_CHARACTER:
+		case INPUT_KEY_UP:
+		case INPUT_KEY_DOWN:
+			fprintf( file, ",\"key\":%u}}", entry->key );
+			break;
+
+		case INPUT_MOUSE_RELATIVE:
+			fprintf( file, ",\"dx\":%g,\"dy\":%g}}", entry->delta[0], entry->delta[1] );
+			break;
+
+		default:
+			fprintf( file, ",\"x\":%d,\"y\":%d}}", entry->pos[0], entry->pos[1] );
+			break;
+		}
+	}
+
+	fprintf( file, "\n]}\n" );
+
+	return true;
+}
+
+static void input_perfetto_packet( FILE* file, const ProtoBuffer* packet )
+{
+	ProtoBuffer header;
+
+	// Trace is a sequence of packets, the packet data is written directly after its tag and length
+	header.size = 0;
+	header.overflow = false;
+
+	proto_varint( &header, TRACE_PACKET << 3 | PROTO_BYTES );
+	proto_varint( &header, packet->size );
+
+	fwrite( header.data, header.size, 1, file );
+	fwrite( packet->data, packet->size, 1, file );
+}
+
+static void input_perfetto_annotation( ProtoBuffer* event, const char* name, uint32 field, uint64 value )
+{
+	ProtoBuffer annotation;
+
+	annotation.size = 0;
+	annotation.overflow = false;
+
+	proto_string( &annotation, ANNOTATION_NAME, name );
+	proto_uint( &annotation, field, value );
+	proto_message( event, EVENT_ANNOTATIONS, &annotation );
+}
+
+static void input_perfetto_annotation_double( ProtoBuffer* event, const char* name, double value )
+{
+	ProtoBuffer annotation;
+
+	annotation.size = 0;
+	annotation.overflow = false;
+
+	proto_string( &annotation, ANNOTATION_NAME, name );
+	proto_double( &annotation, ANNOTATION_DOUBLE, value );
+	proto_message( event, EVENT_ANNOTATIONS, &annotation );
+}
+
+static void input_perfetto_annotation_string( ProtoBuffer* event, const char* name, const char* value )
+{
+	ProtoBuffer annotation;
+
+	annotation.size = 0;
+	annotation.overflow = false;
+
+	proto_string( &annotation, ANNOTATION_NAME, name );
+	proto_string( &annotation, ANNOTATION_STRING, value );
+	proto_message( event, EVENT_ANNOTATIONS, &annotation );
+}
+
+static void input_perfetto_slice( FILE* file, const TimelineEntry* entry, bool begin )
+{
+	ProtoBuffer packet, event;
+	char name[TIMELINE_NAME_SIZE];
+
+	packet.size = event.size = 0;
+	packet.overflow = event.overflow = false;
+
+	proto_uint( &event, EVENT_TYPE, begin ? SLICE_BEGIN : SLICE_END );
+	proto_uint( &event, EVENT_TRACK_UUID, TIMELINE_TRACK_UUID );
+
+	if ( begin )
+	{
+		input_timeline_name( entry, name );
+		proto_string( &event, EVENT_NAME, name );
+
+		input_perfetto_annotation( &event, "consumed", ANNOTATION_BOOL, entry->consumed );
+
+		if ( entry->kind != TIMELINE_EVENT )
+		{
+			input_perfetto_annotation_string( &event, "event", timeline_event_names[entry->type] );
+		}
+		else
+		{
+			input_perfetto_annotation( &event, "wait_ns", ANNOTATION_UINT, entry->wait );
+
+			switch ( entry->type )
+			{
+			case INPUT_CHARACTER:
+			case INPUT_KEY_UP:
+			case INPUT_KEY_DOWN:
+				input_perfetto_annotation( &event, "key", ANNOTATION_UINT, entry->key );
+				break;
+
+			case INPUT_MOUSE_RELATIVE:
+				input_perfetto_annotation_double( &event, "dx", entry->delta[0] );
+				input_perfetto_annotation_double( &event, "dy", entry->delta[1] );
+				break;
+
+			default:
+				input_perfetto_annotation( &event, "x", ANNOTATION_INT, (uint64)(int64)entry->pos[0] );
+				input_perfetto_annotation( &event, "y", ANNOTATION_INT, (uint64)(int64)entry->pos[1] );
+				break;
+			}
+		}
+	}
+
+	proto_uint( &packet, PACKET_TIMESTAMP, begin ? entry->start : entry->end );
+	proto_uint( &packet, PACKET_CLOCK_ID, CLOCK_MONOTONIC_ID );
+	proto_uint( &packet, PACKET_SEQUENCE_ID, TIMELINE_SEQUENCE_ID );
+	proto_uint( &packet, PACKET_SEQUENCE_FLAGS, SEQ_NEEDS_INCREMENTAL_STATE );
+	proto_message( &packet, PACKET_TRACK_EVENT, &event );
+
+	if ( !packet.overflow ) input_perfetto_packet( file, &packet );
+}
+
+static int input_timeline_compare( const void* a, const void* b )
+{
+	const TimelineEntry* x = *(const TimelineEntry* const*)a;
+	const TimelineEntry* y = *(const TimelineEntry* const*)b;
+
+	// Slices which start at the same time are nested by their end time
+	if ( x->start != y->start ) return x->start < y->start ? -1 : 1;
+	if ( x->end != y->end ) return x->end > y->end ? -1 : 1;
+
+	// An event is the parent of the handlers called for it
+	return (int)x->kind - (int)y->kind;
+}
+
+static bool input_timeline_write_perfetto( FILE* file )
+{
+	const TimelineEntry** entries;
+	const TimelineEntry** open;
+	ProtoBuffer packet, descriptor, process;
+	uint32 i, depth = 0;
+
+	packet.size = descriptor.size = process.size = 0;
+	packet.overflow = descriptor.overflow = process.overflow = false;
+
+	proto_uint( &process, PROCESS_PID, input_timeline_pid() );
+
+	proto_uint( &descriptor, DESCRIPTOR_UUID, TIMELINE_TRACK_UUID );
+	proto_string( &descriptor, DESCRIPTOR_NAME, TIMELINE_TRACK_NAME );
+	proto_message( &descriptor, DESCRIPTOR_PROCESS, &process );
+
+	proto_uint( &packet, PACKET_SEQUENCE_ID, TIMELINE_SEQUENCE_ID );
+	proto_uint( &packet, PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED );
+	proto_message( &packet, PACKET_TRACK_DESCRIPTOR, &descriptor );
+
+	input_perfetto_packet( file, &packet );
+
+	if ( timeline_count == 0 ) return true;
+
+	// Perfetto slices are begin and end pairs, so the slices are sorted by their start
+	// and an open slice is ended when the next one does not fit inside it
+	entries = mem_alloc( 2 * timeline_count * sizeof(*entries) );
+	if ( entries == NULL ) return false;
+
+	open = entries + timeline_count;
+
+	for ( i = 0; i < timeline_count; i++ )
+		entries[i] = input_timeline_get( i );
+
+	qsort( entries, timeline_count, sizeof(*entries), input_timeline_compare );
+
+	for ( i = 0; i < timeline_count; i++ )
+	{
+		while ( depth && open[depth-1]->end < entries[i]->end )
+			input_perfetto_slice( file, open[--depth], false );
+
+		input_perfetto_slice( file, entries[i], true );
+		open[depth++] = entries[i];
+	}
+
+	while ( depth )
+		input_perfetto_slice( file, open[--depth], false );
+
+	mem_free( (void*)entries );
+
+	return true;
+}
+
+bool input_write_timeline( const char* path, INPUT_TIMELINE_FORMAT format )
+{
+	FILE* file;
+	bool ret;
+
+	if ( path == NULL || timeline == NULL ) return false;
+
+	file = fopen( path, format == INPUT_TIMELINE_PERFETTO ? "wb" : "w" );
+	if ( file == NULL ) return false;
+
+	if ( format == INPUT_TIMELINE_PERFETTO ) ret = input_timeline_write_perfetto( file );
+	else ret = input_timeline_write_json( file );
+
+	if ( ferror( file ) ) ret = false;
+	if ( fclose( file ) != 0 ) ret = false;
+
+	// The written slices are dropped so the next flush continues from here
+	if ( ret ) input_clear_timeline();
+
+	return ret;
+}
@@ -0,0 +1,400 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputTrace.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		Recording input into binary trace files and
+ *				replaying them.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "InputSys.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+// --------------------------------------------------
+
+// A trace is a header followed by fixed size event records, both in the native byte
+// order. The events are recorded as they are captured (see input_post_record) with
+// the modifier state and time of the capture, times are relative to the start of the
+// recording. The checksum is a 32-bit FNV-1a hash of the event records.
+#define TRACE_MAGIC				0x52544E49		// "INTR"
+#define TRACE_VERSION			1
+#define TRACE_BUFFER_SIZE		256				// Events buffered before writing them out
+
+#define TRACE_FLAG_MODIFIER_KEY	0x1				// The key of the event is a modifier key
+
+#define FNV_OFFSET_BASIS		0x811C9DC5
+#define FNV_PRIME				0x01000193
+
+typedef struct {
+	uint32	magic;
+	uint16	version;
+	uint16	event_size;		// Size of a single event record
+	uint32	count;			// Number of event records
+	uint32	checksum;		// Hash of the event records
+	uint64	start_time;		// Time the recording was started at
+} TraceHeader;
+
+typedef struct {
+	uint64	time;			// Time since the start of the recording in nanoseconds
+	uint32	modifiers;		// Modifier state when the event was captured
+	uint8	type;
+	uint8	button;
+	uint8	wheel;
+	uint8	flags;
+	union {
+		uint32	key;		// Keyboard events
+		int16	pos[2];		// Mouse events
+		float	delta[2];	// Relative mouse events
+	};
+} TraceEvent;
+
+// Events are written by the thread calling input_process while recording may be started
+// and stopped by another one, the lock protects the file and the buffer
+static volatile uint32 trace_lock = 0;
+static FILE* volatile trace_file = NULL;			// Trace being recorded
+static TraceHeader trace_header;
+static TraceEvent trace_buffer[TRACE_BUFFER_SIZE];
+static uint32 trace_buffered = 0;
+static bool trace_failed = false;					// Has writing the trace failed
+
+// --------------------------------------------------
+
+static uint32 input_trace_checksum( uint32 hash, const void* data, size_t size )
+{
+	const uint8* bytes = (const uint8*)data;
+	size_t i;
+
+	for ( i = 0; i < size; i++ )
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static void input_trace_flush( void )
+{
+	size_t size;
+
+	if ( trace_buffered == 0 ) return;
+
+	size = trace_buffered * sizeof(TraceEvent);
+
+	trace_header.checksum = input_trace_checksum( trace_header.checksum, trace_buffer, size );
+	trace_header.count += trace_buffered;
+	trace_buffered = 0;
+
+	if ( fwrite( trace_buffer, size, 1, trace_file ) != 1 ) trace_failed = true;
+}
+
+bool input_start_recording( const char* path )
+{
+	FILE* file;
+
+	if ( path == NULL ) return false;
+
+	file = fopen( path, "wb" );
+	if ( file == NULL ) return false;
+
+	input_stop_recording();
+
+	input_spin_lock( &trace_lock );
+
+	memset( &trace_header, 0, sizeof(trace_header) );
+
+	trace_header.magic = TRACE_MAGIC;
+	trace_header.version = TRACE_VERSION;
+	trace_header.event_size = sizeof(TraceEvent);
+	trace_header.checksum = FNV_OFFSET_BASIS;
+	trace_header.start_time = input_platform_get_time();
+
+	// The header is written again with the final count and checksum when stopping
+	if ( fwrite( &trace_header, sizeof(trace_header), 1, file ) != 1 )
+	{
+		input_spin_unlock( &trace_lock );
+		fclose( file );
+		return false;
+	}
+
+	trace_buffered = 0;
+	trace_failed = false;
+	input_atomic_store_ptr( &trace_file, file );
+
+	input_spin_unlock( &trace_lock );
+
+	return true;
+}
+
+bool input_stop_recording( void )
+{
+	bool ret;
+
+	input_spin_lock( &trace_lock );
+
+	if ( trace_file == NULL )
+	{
+		input_spin_unlock( &trace_lock );
+		return false;
+	}
+
+	input_trace_flush();
+
+	if ( fseek( trace_file, 0, SEEK_SET ) != 0 ||
+		 fwrite( &trace_header, sizeof(trace_header), 1, trace_file ) != 1 )
+	{
+		trace_failed = true;
+	}
+
+	if ( fclose( trace_file ) != 0 ) trace_failed = true;
+
+	ret = !trace_failed;
+
+	input_atomic_store_ptr( &trace_file, NULL );
+	trace_buffered = 0;
+	trace_failed = false;
+
+	input_spin_unlock( &trace_lock );
+
+	return ret;
+}
+
+bool input_is_recording( void )
+{
+	return input_atomic_load_ptr( &trace_file ) != NULL;
+}
+
+void input_trace_shutdown( void )
+{
+	input_stop_recording();
+}
+
+void input_trace_write( const InputEventRecord* record )
+{
+	TraceEvent* event;
+
+	input_spin_lock( &trace_lock );
+
+	// Recording may have been stopped after the caller checked it
+	if ( trace_file == NULL )
+	{
+		input_spin_unlock( &trace_lock );
+		return;
+	}
+
+	event = &trace_buffer[trace_buffered];
+
+	memset( event, 0, sizeof(*event) );
+
+	// Events captured before the recording started are stamped with the start time
+	event->time = record->event.time > trace_header.start_time ? record->event.time - trace_header.start_time : 0;
+	event->modifiers = record->modifiers;
+	event->type = (uint8)record->event.type;
+	event->flags = record->modifier_key ? TRACE_FLAG_MODIFIER_KEY : 0;
+
+	switch ( record->event.type )
+	{
+	case INPUT_CHARACTER:
+	case INPUT_KEY_UP:
+	case INPUT_KEY_DOWN:
+		event->key = record->event.keyboard.key;
+		break;
+
+	case INPUT_MOUSE_RELATIVE:
+		event->delta[0] = record->event.relative.dx;
+		event->delta[1] = record->event.relative.dy;
+		break;
+
+	default:
+		event->pos[0] = record->event.mouse.x;
+		event->pos[1] = record->event.mouse.y;
+		event->button = record->event.mouse.button;
+		event->wheel = record->event.mouse.wheel;
+		break;
+	}
+
+	if ( ++trace_buffered == TRACE_BUFFER_SIZE ) input_trace_flush();
+
+	input_spin_unlock( &trace_lock );
+}
+
+static const uint8* input_trace_map( const char* path, size_t* size )
+{
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER file_size;
+	void* data = NULL;
+
+	file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) return NULL;
+
+	if ( GetFileSizeEx( file, &file_size ) && file_size.QuadPart >= (LONGLONG)sizeof(TraceHeader) )
+	{
+		*size = (size_t)file_size.QuadPart;
+		mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+
+		if ( mapping != NULL )
+		{
+			// The view stays valid after the handles are closed
+			data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( mapping );
+		}
+	}
+
+	CloseHandle( file );
+
+	return (const uint8*)data;
+#else
+	struct stat st;
+	void* data = NULL;
+	int fd;
+
+	fd = open( path, O_RDONLY );
+	if ( fd < 0 ) return NULL;
+
+	if ( fstat( fd, &st ) == 0 && st.st_size >= (off_t)sizeof(TraceHeader) )
+	{
+		// The mapping stays valid after the descriptor is closed
+		*size = (size_t)st.st_size;
+		data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+		if ( data == MAP_FAILED ) data = NULL;
+		else madvise( data, (size_t)st.st_size, MADV_SEQUENTIAL );
+	}
+
+	close( fd );
+
+	return (const uint8*)data;
+#endif
+}
+
+static void input_trace_unmap( const uint8* data, size_t size )
+{
+#ifdef _WIN32
+	UNREFERENCED_PARAM( size );
+	UnmapViewOfFile( data );
+#else
+	munmap( (void*)data, size );
+#endif
+}
+
+static void input_trace_wait( uint64 time )
+{
+	uint64 now;
+
+	now = input_platform_get_time();
+	if ( time <= now ) return;
+
+#ifdef _WIN32
+	Sleep( (DWORD)( ( time - now ) / 1000000 ) );
+#else
+	{
+		struct timespec ts;
+
+		ts.tv_sec = (time_t)( ( time - now ) / 1000000000 );
+		ts.tv_nsec = (long)( ( time - now ) % 1000000000 );
+
+		nanosleep( &ts, NULL );
+	}
+#endif
+}
+
+bool input_replay( const char* path, INPUT_REPLAY_MODE mode )
+{
+	const uint8* data;
+	const TraceHeader* header;
+	const TraceEvent* events;
+	const TraceEvent* event;
+	InputEventRecord record;
+	size_t size;
+	uint64 base;
+	uint32 i;
+
+	if ( path == NULL ) return false;
+
+	data = input_trace_map( path, &size );
+	if ( data == NULL ) return false;
+
+	header = (const TraceHeader*)data;
+	events = (const TraceEvent*)( data + sizeof(TraceHeader) );
+
+	if ( header->magic != TRACE_MAGIC || header->version != TRACE_VERSION ||
+		 header->event_size != sizeof(TraceEvent) ||
+		 header->count > ( size - sizeof(TraceHeader) ) / sizeof(TraceEvent) ||
+		 header->checksum != input_trace_checksum( FNV_OFFSET_BASIS, events, header->count * sizeof(TraceEvent) ) )
+	{
+		input_trace_unmap( data, size );
+		return false;
+	}
+
+	// Event times are moved to the current time, the first event is replayed right away
+	base = input_platform_get_time();
+	if ( header->count ) base -= events[0].time;
+
+	for ( i = 0; i < header->count; i++ )
+	{
+		event = &events[i];
+
+		// Skip records the recorder could not have written
+		if ( event->type >= NUM_INPUT_EVENTS || event->button > MOUSE_RBUTTON ) continue;
+
+		if ( mode == INPUT_REPLAY_REALTIME ) input_trace_wait( base + event->time );
+
+		memset( &record, 0, sizeof(record) );
+
+		record.event.type = (INPUT_EVENT)event->type;
+		record.event.time = base + event->time;
+		record.modifiers = event->modifiers;
+		record.modifier_key = ( event->flags & TRACE_FLAG_MODIFIER_KEY ) != 0;
+
+		switch ( record.event.type )
+		{
+		case INPUT_KEY_UP:
+		case INPUT_KEY_DOWN:
+			input_set_key_state( input_platform_get_key_code( event->key ), record.event.type == INPUT_KEY_DOWN );
+			record.event.keyboard.key = event->key;
+			break;
+
+		case INPUT_CHARACTER:
+			record.event.keyboard.key = event->key;
+			break;
+
+		case INPUT_MOUSE_RELATIVE:
+			record.event.relative.dx = event->delta[0];
+			record.event.relative.dy = event->delta[1];
+			break;
+
+		default:
+			record.event.mouse.x = event->pos[0];
+			record.event.mouse.y = event->pos[1];
+			record.event.mouse.button = event->button;
+			record.event.mouse.wheel = event->wheel;
+			break;
+		}
+
+		// Modifier state is restored with the key bitmap so input_get_modifiers matches the trace
+		input_set_modifiers( ~INPUT_MOD_LOCKS, false );
+		input_set_modifiers( event->modifiers & ~INPUT_MOD_LOCKS, true );
+		input_set_lock_state( event->modifiers );
+
+		input_submit_record( &record );
+	}
+
+	input_trace_unmap( data, size );
+
+	return true;
+}
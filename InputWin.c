@@ -10,130 +10,230 @@
  *
  **********************************************************************/
 
-#ifdef _WIN32
+#if defined(_WIN32) && !defined(INPUT_HEADLESS)
 
 #include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <string.h>
 
 // --------------------------------------------------
 
-static HWND	hwnd = NULL;
-static WNDPROC old_proc = NULL;
-static bool input_hooked = false;
+// Backend state of a context. The window procedure installed by input_enable_hook
+// finds the context of the window through a window property.
+typedef struct {
+	HWND			hwnd;
+	WNDPROC			old_proc;
+	bool			input_hooked;
+	InputClockSync	message_clock;		// Converts message times to the local clock
+} InputWin;
+
+#define INPUT_CONTEXT_PROP	"MyllyInputContext"
+
+#define input_win() ( (InputWin*)input_context_state()->platform )
+
+static LARGE_INTEGER counter_frequency;
 
 // --------------------------------------------------
 
 static LRESULT __stdcall input_process_hook( HWND wnd, UINT uMsg, WPARAM wParam, LPARAM lParam );
+static void input_sync_key_states( void );
 
 // --------------------------------------------------
 
+static uint32 input_get_modifier( WPARAM vk, LPARAM lparam )
+{
+	// Windows reports generic virtual keys for the modifiers, the side is
+	// resolved from the scan code and the extended key flag.
+	switch ( vk )
+	{
+	case VK_SHIFT:
+		return MapVirtualKey( ( lparam >> 16 ) & 0xFF, MAPVK_VSC_TO_VK_EX ) == VK_RSHIFT ?
+			INPUT_MOD_RSHIFT : INPUT_MOD_LSHIFT;
+
+	case VK_CONTROL: return ( lparam & ( 1 << 24 ) ) ? INPUT_MOD_RCONTROL : INPUT_MOD_LCONTROL;
+	case VK_MENU: return ( lparam & ( 1 << 24 ) ) ? INPUT_MOD_RALT : INPUT_MOD_LALT;
+	case VK_LWIN: return INPUT_MOD_LSUPER;
+	case VK_RWIN: return INPUT_MOD_RSUPER;
+	}
+
+	return 0;
+}
+
+static void input_update_locks( void )
+{
+	uint32 locks = 0;
+
+	if ( GetKeyState( VK_CAPITAL ) & 1 ) locks |= INPUT_MOD_CAPSLOCK;
+	if ( GetKeyState( VK_NUMLOCK ) & 1 ) locks |= INPUT_MOD_NUMLOCK;
+	if ( GetKeyState( VK_SCROLL ) & 1 ) locks |= INPUT_MOD_SCROLLLOCK;
+
+	input_set_lock_state( locks );
+}
+
 void input_platform_initialize( void* window )
 {
-	hwnd = (HWND)window;
+	InputWin* win;
+
+	QueryPerformanceFrequency( &counter_frequency );
+
+	win = mem_alloc_clean( sizeof(*win) );
+	if ( win == NULL ) return;
+
+	win->hwnd = (HWND)window;
+	input_clock_reset( &win->message_clock );
+
+	SetProp( win->hwnd, INPUT_CONTEXT_PROP, (HANDLE)input_get_context() );
+	input_context_state()->platform = win;
 }
 
 void input_platform_shutdown( void )
 {
-	if ( input_hooked )
-	{
-		SetWindowLong( hwnd, GWL_WNDPROC, (LONG)old_proc );
+	InputContextState* state = input_context_state();
+	InputWin* win = (InputWin*)state->platform;
 
-		old_proc = false;
-		input_hooked = false;
-	}
+	if ( win == NULL ) return;
+
+	if ( win->input_hooked )
+		SetWindowLong( win->hwnd, GWL_WNDPROC, (LONG)win->old_proc );
+
+	RemoveProp( win->hwnd, INPUT_CONTEXT_PROP );
 
-	hwnd = NULL;
+	mem_free( win );
+	state->platform = NULL;
+}
+
+uint64 input_platform_get_time( void )
+{
+	LARGE_INTEGER counter;
+
+	QueryPerformanceCounter( &counter );
+
+	// Split the conversion to avoid overflowing the intermediate result
+	return (uint64)( counter.QuadPart / counter_frequency.QuadPart ) * 1000000000 +
+		   (uint64)( counter.QuadPart % counter_frequency.QuadPart ) * 1000000000 / counter_frequency.QuadPart;
 }
 
 void input_enable_hook( bool enable )
 {
-	if ( enable && !input_hooked )
+	InputWin* win = input_win();
+
+	if ( win == NULL ) return;
+
+	if ( enable && !win->input_hooked )
 	{
-		old_proc = (WNDPROC)GetWindowLong( hwnd, GWL_WNDPROC );
-		input_hooked = true;
+		win->old_proc = (WNDPROC)GetWindowLong( win->hwnd, GWL_WNDPROC );
+		win->input_hooked = true;
 	}
-	else if ( !enable && input_hooked )
+	else if ( !enable && win->input_hooked )
 	{
-		SetWindowLong( hwnd, GWL_WNDPROC, (LONG)old_proc );
+		SetWindowLong( win->hwnd, GWL_WNDPROC, (LONG)win->old_proc );
 
-		old_proc = NULL;
-		input_hooked = false;
+		win->old_proc = NULL;
+		win->input_hooked = false;
 	}
 }
 
 bool input_process( void* data )
 {
+	InputWin* win;
 	MSG* msg;
 	bool ret;
 	int16 x, y;
 
 	msg = (MSG*)data;
+	win = input_win();
 
-	if ( data == NULL && input_hooked )
+	if ( win == NULL ) return true;
+
+	if ( data == NULL && win->input_hooked )
 	{
-		if ( hwnd && old_proc ) SetWindowLong( hwnd, GWL_WNDPROC, (LONG)input_process_hook );
+		if ( win->hwnd && win->old_proc ) SetWindowLong( win->hwnd, GWL_WNDPROC, (LONG)input_process_hook );
 		return true;
 	}
 
+	// Message time is the GetTickCount time the message was posted at
+	input_set_event_time( input_clock_convert( &win->message_clock, (uint32)msg->time, input_platform_get_time() ) );
+
 	switch ( msg->message )
 	{
 	case WM_CHAR:
 		{
-			ret = input_handle_keyboard_event( INPUT_CHARACTER, (uint32)msg->wParam );
-			if ( ret )
-			{
-				ret = input_handle_char_bind( (uint32)msg->wParam );
-			}
-
-			return ret;
+			return input_post_key_event( INPUT_CHARACTER, (uint32)msg->wParam );
 		}
 
 	case WM_KEYUP:
 	case WM_SYSKEYUP:
 		{
-			ret = input_handle_keyboard_event( INPUT_KEY_UP, (uint32)msg->wParam );
-			if ( ret )
-			{
-				ret = input_handle_key_up_bind( (uint32)msg->wParam );
-			}
+			input_set_modifiers( input_get_modifier( msg->wParam, msg->lParam ), false );
+			input_update_locks();
+			input_set_key_state( (uint32)msg->wParam, false );
 
-			return ret;
+			return input_post_key_event( INPUT_KEY_UP, (uint32)msg->wParam );
 		}
 
 	case WM_KEYDOWN:
 	case WM_SYSKEYDOWN:
 		{
-			ret = input_handle_keyboard_event( INPUT_KEY_DOWN, (uint32)msg->wParam );
-			if ( ret )
-			{
-				ret = input_handle_key_down_bind( (uint32)msg->wParam );
-			}
+			input_set_modifiers( input_get_modifier( msg->wParam, msg->lParam ), true );
+			input_update_locks();
+			input_set_key_state( (uint32)msg->wParam, true );
+
+			ret = input_post_key_event( INPUT_KEY_DOWN, (uint32)msg->wParam );
 
 			if ( !ret )
 			{
 				// This is here because the windows input model is retarded and also sends a WM_CHAR event for pressed down keys
-				while ( PeekMessage( msg, hwnd, WM_CHAR, WM_CHAR, PM_REMOVE ) ) {}
+				while ( PeekMessage( msg, win->hwnd, WM_CHAR, WM_CHAR, PM_REMOVE ) ) {}
 			}
 
 			return ret;
 		}
 
+	case WM_SETFOCUS:
+		{
+			// Keys may have been pressed or released while another window had the focus
+			input_sync_key_states();
+			return true;
+		}
+
+	case WM_KILLFOCUS:
+		{
+			// Key releases are not delivered to unfocused windows, drop the held keys
+			input_set_modifiers( ~INPUT_MOD_LOCKS, false );
+			input_set_key_states( NULL );
+			return true;
+		}
+
+	case WM_INPUT:
+		{
+			RAWINPUT raw;
+			UINT size = sizeof(raw);
+
+			if ( !input_is_relative_mouse() ) return true;
+
+			if ( GetRawInputData( (HRAWINPUT)msg->lParam, RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER) ) == (UINT)-1 )
+				return true;
+
+			// Absolute devices (tablets, remote desktop) don't report relative motion
+			if ( raw.header.dwType != RIM_TYPEMOUSE || ( raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE ) )
+				return true;
+
+			if ( raw.data.mouse.lLastX == 0 && raw.data.mouse.lLastY == 0 ) return true;
+
+			return input_post_relative_event( (float)raw.data.mouse.lLastX, (float)raw.data.mouse.lLastY );
+		}
+
 	case WM_MOUSEMOVE:
 		{
 			x = (int16)LOWORD(msg->lParam);
 			y = (int16)HIWORD(msg->lParam);
 
-			ret = input_handle_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_move_bind( x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
 		}
 
 	case WM_MOUSEWHEEL:
 		{
-			return input_handle_mouse_event( INPUT_MOUSE_WHEEL,
+			return input_post_mouse_event( INPUT_MOUSE_WHEEL,
 				(int16)LOWORD(msg->lParam), (int16)HIWORD(msg->lParam), MOUSE_NONE,
 				(float)((short)HIWORD((DWORD)msg->wParam)) > 0 ? MWHEEL_UP : MWHEEL_DOWN );
 		}
@@ -145,13 +245,7 @@ bool input_process( void* data )
 
 			ReleaseCapture();
 
-			ret = input_handle_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				input_handle_mouse_up_bind( MOUSE_LBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_LBUTTONDOWN:
@@ -161,13 +255,7 @@ bool input_process( void* data )
 
 			SetCapture( msg->hwnd );
 
-			ret = input_handle_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_LBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_MBUTTONUP:
@@ -176,15 +264,9 @@ bool input_process( void* data )
 			y = (int16)HIWORD(msg->lParam);
 
 			ReleaseCapture();
-			ClipCursor( NULL );
-
-			ret = input_handle_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_up_bind( MOUSE_MBUTTON, x, y );
-			}
+			if ( !input_is_relative_mouse() ) ClipCursor( NULL );
 
-			return ret;
+			return input_post_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_MBUTTONDOWN:
@@ -194,13 +276,7 @@ bool input_process( void* data )
 
 			SetCapture( msg->hwnd );
 
-			ret = input_handle_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_MBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_RBUTTONUP:
@@ -210,13 +286,7 @@ bool input_process( void* data )
 
 			ReleaseCapture();
 
-			ret = input_handle_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_up_bind( MOUSE_RBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_RBUTTONDOWN:
@@ -226,13 +296,7 @@ bool input_process( void* data )
 
 			SetCapture( msg->hwnd );
 
-			ret = input_handle_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_RBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 		}
 	}
 
@@ -241,68 +305,139 @@ bool input_process( void* data )
 
 static LRESULT __stdcall input_process_hook( HWND wnd, UINT uMsg, WPARAM wParam, LPARAM lParam )
 {
+	input_context_t* prev;
+	InputWin* win;
+	WNDPROC old_proc;
 	MSG msg;
-	
-	if ( old_proc == NULL || wnd != hwnd ) return 0;
+	bool ret;
+
+	// The message belongs to the context of the window, whichever context is current
+	prev = input_set_context( (input_context_t*)GetProp( wnd, INPUT_CONTEXT_PROP ) );
+	win = input_win();
+
+	if ( win == NULL || win->old_proc == NULL || wnd != win->hwnd )
+	{
+		input_set_context( prev );
+		return 0;
+	}
+
+	old_proc = win->old_proc;
 
 	msg.hwnd = wnd;
 	msg.message = uMsg;
 	msg.wParam = wParam;
 	msg.lParam = lParam;
+	msg.time = (DWORD)GetMessageTime();
 
-	if ( input_process( &msg ) )
-		return CallWindowProc( old_proc, hwnd, uMsg, wParam, lParam );
+	ret = input_process( &msg );
+	input_set_context( prev );
+
+	if ( ret )
+		return CallWindowProc( old_proc, wnd, uMsg, wParam, lParam );
 	
 	return 0;
 }
 
-bool input_get_key_state( uint32 key )
+uint32 input_platform_get_key_code( uint32 key )
 {
-	return ( GetKeyState( key ) & 0x8000 ) != 0;
+	// Virtual key codes are used as is
+	return key < INPUT_KEY_STATE_SIZE ? key : INPUT_KEY_CODE_NONE;
 }
 
-void input_show_mouse_cursor( bool show )
+static void input_sync_key_states( void )
 {
-	extern bool show_cursor;
+	BYTE state[256];
+	uint8 keys[INPUT_KEY_STATE_SIZE / 8];
+	uint32 i;
 
-	show_cursor = show;
+	if ( !GetKeyboardState( state ) ) return;
+
+	memset( keys, 0, sizeof(keys) );
+
+	for ( i = 0; i < 256; i++ )
+	{
+		if ( state[i] & 0x80 ) keys[i >> 3] |= 1 << ( i & 7 );
+	}
+
+	input_set_key_states( keys );
+}
+
+void input_show_mouse_cursor( bool show )
+{
+	input_context_state()->show_cursor = show;
 	ShowCursor( show );
 }
 
 void input_show_mouse_cursor_ref( bool show )
 {
-	static uint32 refcount = 0;
-	extern bool show_cursor;
+	InputContextState* state = input_context_state();
 
 	if ( !show )
 	{
-		if ( refcount )
+		if ( state->cursor_refs )
 		{
-			if ( --refcount == 0 )
+			if ( --state->cursor_refs == 0 )
 			{
 				ShowCursor( FALSE );
-				show_cursor = false;
+				state->show_cursor = false;
 			}
 		}
 	}
 	else
 	{
-		if ( refcount++ == 0 )
+		if ( state->cursor_refs++ == 0 )
 		{
 			ShowCursor( TRUE );
-			show_cursor = true;
+			state->show_cursor = true;
 		}
 	}
 }
 
 void input_set_cursor_pos( int16 x, int16 y )
 {
-	extern int16 mouse_x, mouse_y;
+	InputContextState* state = input_context_state();
 
-	mouse_x = x;
-	mouse_y = y;
+	state->mouse_x = x;
+	state->mouse_y = y;
 
 	SetCursorPos( x, y );
 }
 
-#endif /* _WIN32 */
+bool input_platform_set_relative_mouse( bool enable )
+{
+	InputWin* win = input_win();
+	RAWINPUTDEVICE device;
+	RECT rect;
+	HWND hwnd;
+
+	if ( win == NULL ) return false;
+
+	hwnd = win->hwnd;
+
+	// Raw mouse input is not affected by the pointer speed or acceleration settings
+	device.usUsagePage = 0x01;	// Generic desktop controls
+	device.usUsage = 0x02;		// Mouse
+	device.dwFlags = enable ? 0 : RIDEV_REMOVE;
+	device.hwndTarget = enable ? hwnd : NULL;
+
+	if ( hwnd == NULL || !RegisterRawInputDevices( &device, 1, sizeof(device) ) ) return false;
+
+	if ( enable )
+	{
+		// Confine the cursor to the client area of the window
+		GetClientRect( hwnd, &rect );
+		MapWindowPoints( hwnd, NULL, (POINT*)&rect, 2 );
+
+		ClipCursor( &rect );
+		ShowCursor( FALSE );
+	}
+	else
+	{
+		ClipCursor( NULL );
+		ShowCursor( TRUE );
+	}
+
+	return true;
+}
+
+#endif /* _WIN32 && !INPUT_HEADLESS */
@@ -10,36 +10,189 @@
  *
  **********************************************************************/
 
-#ifndef _WIN32
+#if !defined(_WIN32) && !defined(INPUT_HEADLESS) && !defined(INPUT_XCB) && !defined(INPUT_EVDEV)
 
 #include "Input.h"
 #include "InputSys.h"
+#include "Platform/Alloc.h"
 #include "Platform/Window.h"
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
+#include <X11/extensions/XInput2.h>
+#include <string.h>
+#include <time.h>
 
 // --------------------------------------------------
 
-static syswindow_t* window = NULL;
-static uint32 modifier_flags = 0;
+// Backend state of a context
+typedef struct {
+	syswindow_t*	window;
+	InputClockSync	server_clock;		// Converts X server time to the local clock
+	int				xi_opcode;			// Major opcode of the XInput extension, -1 without XInput 2
+} InputX11;
+
+#define input_x11() ( (InputX11*)input_context_state()->platform )
 
 // --------------------------------------------------
 
+static void input_hide_mouse_cursor( void );
+
+// --------------------------------------------------
+
+static uint32 input_get_modifier( KeySym sym )
+{
+	switch ( sym )
+	{
+	case XK_Shift_L: return INPUT_MOD_LSHIFT;
+	case XK_Shift_R: return INPUT_MOD_RSHIFT;
+	case XK_Control_L: return INPUT_MOD_LCONTROL;
+	case XK_Control_R: return INPUT_MOD_RCONTROL;
+	case XK_Alt_L: case XK_Meta_L: return INPUT_MOD_LALT;
+	case XK_Alt_R: case XK_Meta_R: case XK_ISO_Level3_Shift: return INPUT_MOD_RALT;
+	case XK_Super_L: return INPUT_MOD_LSUPER;
+	case XK_Super_R: return INPUT_MOD_RSUPER;
+	}
+
+	return 0;
+}
+
+static void input_update_locks( XKeyEvent* key, KeySym sym, bool press )
+{
+	uint32 locks;
+
+	// The state of the event is the state before the key was pressed
+	locks = input_get_modifiers() & INPUT_MOD_SCROLLLOCK;
+	if ( key->state & LockMask ) locks |= INPUT_MOD_CAPSLOCK;
+	if ( key->state & Mod2Mask ) locks |= INPUT_MOD_NUMLOCK;
+
+	if ( press )
+	{
+		switch ( sym )
+		{
+		case XK_Caps_Lock: locks ^= INPUT_MOD_CAPSLOCK; break;
+		case XK_Num_Lock: locks ^= INPUT_MOD_NUMLOCK; break;
+		case XK_Scroll_Lock: locks ^= INPUT_MOD_SCROLLLOCK; break;
+		}
+	}
+
+	input_set_lock_state( locks );
+}
+
+static void input_query_xi2( InputX11* x11 )
+{
+	int event, error, major = 2, minor = 0;
+
+	// Raw events are available since XInput 2.0
+	if ( !XQueryExtension( x11->window->display, "XInputExtension", &x11->xi_opcode, &event, &error ) ||
+		 XIQueryVersion( x11->window->display, &major, &minor ) != Success )
+	{
+		x11->xi_opcode = -1;
+	}
+}
+
 void input_platform_initialize( void* wnd )
 {
-	window = wnd;
+	InputX11* x11;
+
+	x11 = mem_alloc_clean( sizeof(*x11) );
+	if ( x11 == NULL ) return;
+
+	x11->window = wnd;
+	input_clock_reset( &x11->server_clock );
+
+	input_query_xi2( x11 );
+	input_context_state()->platform = x11;
 }
 
 void input_platform_shutdown( void )
 {
-	window = NULL;
+	InputContextState* state = input_context_state();
+
+	if ( state->platform ) mem_free( state->platform );
+	state->platform = NULL;
+}
+
+uint64 input_platform_get_time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64)ts.tv_sec * 1000000000 + (uint64)ts.tv_nsec;
+}
+
+static void input_update_event_time( XEvent* event )
+{
+	InputX11* x11 = input_x11();
+	uint64 now;
+
+	now = input_platform_get_time();
+
+	// Only input events carry the server time, the rest are stamped when received
+	switch ( event->type )
+	{
+	case KeyPress:
+	case KeyRelease:
+		now = input_clock_convert( &x11->server_clock, (uint32)event->xkey.time, now );
+		break;
+
+	case ButtonPress:
+	case ButtonRelease:
+		now = input_clock_convert( &x11->server_clock, (uint32)event->xbutton.time, now );
+		break;
+
+	case MotionNotify:
+		now = input_clock_convert( &x11->server_clock, (uint32)event->xmotion.time, now );
+		break;
+	}
+
+	input_set_event_time( now );
 }
 
 void input_enable_hook( bool enable )
 {
 	// We actually don't have a working hook for X window system... yet.
 	UNREFERENCED_PARAM( enable );
+}
+
+static bool input_process_raw_motion( XIRawEvent* raw )
+{
+	InputX11* x11 = input_x11();
+	double delta[2] = { 0, 0 };
+	int i, value = 0;
+
+	// Raw values are packed, there is a value for each bit set in the valuator mask.
+	// Valuators 0 and 1 are the relative X and Y axes of a mouse.
+	for ( i = 0; i < 2 && i < raw->valuators.mask_len * 8; i++ )
+	{
+		if ( XIMaskIsSet( raw->valuators.mask, i ) )
+			delta[i] = raw->raw_values[value++];
+	}
+
+	if ( delta[0] == 0 && delta[1] == 0 ) return true;
+
+	input_set_event_time( input_clock_convert( &x11->server_clock, (uint32)raw->time, input_platform_get_time() ) );
+
+	return input_post_relative_event( (float)delta[0], (float)delta[1] );
+}
+
+static bool input_process_xi2( XGenericEventCookie* cookie )
+{
+	InputX11* x11 = input_x11();
+	bool owned, ret = true;
+
+	if ( x11->xi_opcode < 0 || cookie->extension != x11->xi_opcode ) return true;
+	if ( cookie->evtype != XI_RawMotion || !input_is_relative_mouse() ) return true;
+
+	// The application may have fetched the event data already
+	owned = XGetEventData( cookie->display, cookie ) != False;
+
+	if ( cookie->data != NULL )
+		ret = input_process_raw_motion( (XIRawEvent*)cookie->data );
+
+	if ( owned ) XFreeEventData( cookie->display, cookie );
+
+	return ret;
 }
 
 bool input_process( void* data )
@@ -54,51 +207,43 @@ bool input_process( void* data )
 	uint32 code;
 	bool ret = true;
 
+	if ( input_x11() == NULL ) return true;
+
+	input_update_event_time( event );
+
 	switch ( event->type )
 	{
 	case KeyPress:
 		{
 			key = (XKeyEvent*)event;
-			modifier_flags = key->state;
 
 			XLookupString( key, buf, sizeof(buf), &sym, NULL );
 			code = (uint32)sym;
 
+			input_set_modifiers( input_get_modifier( sym ), true );
+			input_update_locks( key, sym, true );
+			input_set_key_state( key->keycode, true );
+
 			// A dodgy fix to make windows and linux hooks/binds compatible:
 			// Convert lowercase characters to upper case before processing hooks.
 			if ( code >= 'a' && code <= 'z' ) code -= ( 'a' - 'A' );
 
-			ret = input_handle_keyboard_event( INPUT_KEY_DOWN, code );
-			if ( ret )
-			{
-				ret = input_handle_key_down_bind( code );
-			}
+			if ( !input_post_key_event( INPUT_KEY_DOWN, code ) ) return false;
+			if ( !*buf ) return true;
 
-			if ( !ret ) return false;
-			if ( !*buf ) return ret;
-
-			ret = input_handle_keyboard_event( INPUT_CHARACTER, buf[0] );
-			if ( ret )
-			{
-				ret = input_handle_char_bind( buf[0] );
-			}
-
-			return ret;
+			return input_post_key_event( INPUT_CHARACTER, buf[0] );
 		}
 
 	case KeyRelease:
 		{
-			modifier_flags = 0;
 			key = (XKeyEvent*)event;
-			sym = (uint32)XkbKeycodeToKeysym( window->display, key->keycode, 0, 0 );
+			sym = (uint32)XkbKeycodeToKeysym( key->display, key->keycode, 0, 0 );
 
-			ret = input_handle_keyboard_event( INPUT_KEY_UP, (uint32)sym );
-			if ( ret )
-			{
-				ret = input_handle_key_up_bind( (uint32)sym );
-			}
-
-			return ret;
+			input_set_modifiers( input_get_modifier( sym ), false );
+			input_update_locks( key, sym, false );
+			input_set_key_state( key->keycode, false );
+
+			return input_post_key_event( INPUT_KEY_UP, (uint32)sym );
 		}
 
 	case ButtonPress:
@@ -111,38 +256,38 @@ bool input_process( void* data )
 			switch ( button->button )
 			{
 			case Button1:
-				// Left mouse button
-				XGrabPointer( button->display, button->window, False, ButtonPressMask|ButtonReleaseMask|
-								PointerMotionMask|FocusChangeMask|EnterWindowMask|LeaveWindowMask,
-								GrabModeAsync, GrabModeAsync, button->window, None, CurrentTime );
+				// Left mouse button. In relative mode the pointer is already grabbed.
+				if ( !input_is_relative_mouse() )
+				{
+					XGrabPointer( button->display, button->window, False, ButtonPressMask|ButtonReleaseMask|
+									PointerMotionMask|FocusChangeMask|EnterWindowMask|LeaveWindowMask,
+									GrabModeAsync, GrabModeAsync, button->window, None, CurrentTime );
+				}
 
-				ret = input_handle_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_LBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button3:
 				// Right mouse button
-				ret = input_handle_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_RBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button2:
 				// Middle mouse button (wheel)
-				ret = input_handle_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_MBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button4:
 				// Mouse wheel scroll up
-				ret = input_handle_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_UP );
+				ret = input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_UP );
 				break;
 
 			case Button5:
 				// Mouse wheel scroll down
-				ret = input_handle_mouse_event( INPUT_MOUSE_WHEEL,x, y, MOUSE_NONE, MWHEEL_DOWN );
+				ret = input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_DOWN );
 				break;
 			}
 
@@ -160,24 +305,21 @@ bool input_process( void* data )
 			{
 			case Button1:
 				// Left mouse button
-				XUngrabPointer( button->display, CurrentTime );
+				if ( !input_is_relative_mouse() ) XUngrabPointer( button->display, CurrentTime );
 
-				ret = input_handle_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_LBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
-			case Button2:
+			case Button3:
 				// Right mouse button
-				ret = input_handle_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_RBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
-			case Button3:
+			case Button2:
 				// Middle mouse button (wheel)
-				ret = input_handle_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_MBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 
 				break;
 			}
@@ -191,58 +333,62 @@ bool input_process( void* data )
 			x = (int16)motion->x;
 			y = (int16)motion->y;
 
-			ret = input_handle_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_move_bind( x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
 		}
-	}
 
-	return true;
-}
-
-bool input_get_key_state( uint32 key )
-{
-	char keys[32];
-	uint32 code;
-	uint32 idx;
+	case GenericEvent:
+		{
+			return input_process_xi2( &event->xcookie );
+		}
 
-	switch ( key )
-	{
-	case MKEY_SHIFT:
-		return ( modifier_flags & ShiftMask );
+	case FocusIn:
+		{
+			// Keys may have been pressed or released while another window had the focus
+			char keys[32];
 
-	case MKEY_CONTROL:
-		return ( modifier_flags & ControlMask );
+			XQueryKeymap( event->xfocus.display, keys );
+			input_set_key_states( (uint8*)keys );
 
-	case MKEY_ALT:
-		return ( modifier_flags & Mod1Mask );
+			return true;
+		}
 
-	case MKEY_RALT:
-		return ( modifier_flags & Mod5Mask );
+	case KeymapNotify:
+		{
+			input_set_key_states( (uint8*)event->xkeymap.key_vector );
+			return true;
+		}
 
-	default:
-		code = XKeysymToKeycode( window->display, key );
+	case FocusOut:
+		{
+			// Releases are not delivered to unfocused windows, drop the held keys
+			input_set_modifiers( ~INPUT_MOD_LOCKS, false );
+			input_set_key_states( NULL );
+			return true;
+		}
+	}
 
-		XQueryKeymap( window->display, keys );
-		idx = code >> 3;
+	return true;
+}
 
-		return keys[idx] & ( (code-idx) << 3 );
-	}
+uint32 input_platform_get_key_code( uint32 key )
+{
+	InputX11* x11 = input_x11();
+
+	// The keyboard mapping is cached by Xlib, this does not talk to the server
+	if ( x11 == NULL ) return INPUT_KEY_CODE_NONE;
+	return (uint32)XKeysymToKeycode( x11->window->display, (KeySym)key );
 }
 
 static void input_hide_mouse_cursor( void )
 {
-	// A really dodgy way to hide the mouse cursor...
+	syswindow_t* window = input_x11()->window;
 	Pixmap bm;
 	Colormap cmap;
 	Cursor cursor;
 	XColor black, dummy;
 	static char bm_no_data[] = { 0, 0, 0, 0, 0, 0, 0, 0 };
 
+	// A really dodgy way to hide the mouse cursor...
 	cmap = DefaultColormap( window->display, DefaultScreen(window->display) );
 	XAllocNamedColor( window->display, cmap, "black", &black, &dummy );
 	bm = XCreateBitmapFromData( window->display, window->window, bm_no_data, 8, 8 );
@@ -259,9 +405,9 @@ static void input_hide_mouse_cursor( void )
 
 void input_show_mouse_cursor( bool show )
 {
-	extern bool show_cursor;
+	syswindow_t* window = input_x11()->window;
 
-	show_cursor = show;
+	input_context_state()->show_cursor = show;
 
 	if ( show )
 	{
@@ -275,38 +421,87 @@ void input_show_mouse_cursor( bool show )
 
 void input_show_mouse_cursor_ref( bool show )
 {
-	static uint32 refcount = 0;
-	extern bool show_cursor;
+	InputContextState* state = input_context_state();
+	syswindow_t* window = input_x11()->window;
 
 	if ( !show )
 	{
-		if ( refcount )
+		if ( state->cursor_refs )
 		{
-			if ( --refcount == 0 )
+			if ( --state->cursor_refs == 0 )
 			{
 				input_hide_mouse_cursor();
-				show_cursor = false;
+				state->show_cursor = false;
 			}
 		}
 	}
 	else
 	{
-		if ( refcount++ == 0 )
+		if ( state->cursor_refs++ == 0 )
 		{
 			XUndefineCursor( window->display, window->window );
-			show_cursor = true;
+			state->show_cursor = true;
 		}
 	}
 }
 
 void input_set_cursor_pos( int16 x, int16 y )
 {
-	extern int16 mouse_x, mouse_y;
+	InputContextState* state = input_context_state();
+	syswindow_t* window = input_x11()->window;
 
-	mouse_x = x;
-	mouse_y = y;
+	state->mouse_x = x;
+	state->mouse_y = y;
 
 	XWarpPointer( window->display, None, RootWindow(window->display, window->window), 0, 0, 0, 0, x, y );
 }
 
-#endif /* _WIN32 */
+bool input_platform_set_relative_mouse( bool enable )
+{
+	InputX11* x11 = input_x11();
+	syswindow_t* window;
+	XIEventMask mask;
+	unsigned char bits[XIMaskLen( XI_LASTEVENT )];
+	Window root;
+
+	if ( x11 == NULL || x11->xi_opcode < 0 ) return false;
+
+	window = x11->window;
+
+	root = DefaultRootWindow( window->display );
+
+	memset( bits, 0, sizeof(bits) );
+	if ( enable ) XISetMask( bits, XI_RawMotion );
+
+	mask.deviceid = XIAllMasterDevices;
+	mask.mask_len = sizeof(bits);
+	mask.mask = bits;
+
+	if ( enable )
+	{
+		// Confine the pointer to the window. Raw motion keeps coming when the pointer
+		// hits the edge of the window, so it never has to be warped back.
+		if ( XGrabPointer( window->display, window->window, False, ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
+						   GrabModeAsync, GrabModeAsync, window->window, None, CurrentTime ) != GrabSuccess )
+		{
+			return false;
+		}
+
+		// Raw events are only delivered to the root window
+		XISelectEvents( window->display, root, &mask, 1 );
+		input_hide_mouse_cursor();
+	}
+	else
+	{
+		XISelectEvents( window->display, root, &mask, 1 );
+		XUngrabPointer( window->display, CurrentTime );
+
+		if ( input_is_cursor_showing() ) XUndefineCursor( window->display, window->window );
+	}
+
+	XFlush( window->display );
+
+	return true;
+}
+
+#endif /* !_WIN32 && !INPUT_HEADLESS && !INPUT_XCB && !INPUT_EVDEV */
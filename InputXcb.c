@@ -0,0 +1,664 @@
+/**********************************************************************
+ *
+ * PROJECT:		Input library
+ * FILE:		InputXcb.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Functions to query X11 input systems through XCB.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#if !defined(_WIN32) && !defined(INPUT_HEADLESS) && defined(INPUT_XCB)
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <xcb/xproto.h>
+#include <X11/keysym.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+
+// The backend never waits for the server. Requests with a reply only store the sequence
+// number of their cookie, the replies are picked up with xcb_poll_for_reply when
+// input_process is called after they have arrived. Until the keyboard mapping has
+// arrived key events only update the key bitmap.
+
+// A request whose reply hasn't been picked up yet
+typedef struct {
+	uint32				sequence;
+	bool				pending;
+} InputXcbRequest;
+
+// Backend state of a context
+typedef struct {
+	xcb_connection_t*	connection;
+	xcb_window_t		window;
+	xcb_window_t		root;				// Root window of the screen the window is on
+	input_event_func_t	event_func;			// Receives the unconsumed events when pumping
+	void*				event_data;
+	InputClockSync		server_clock;		// Converts X server time to the local clock
+	xcb_keycode_t		min_keycode;		// Key code of the first entry in the keyboard mapping
+	xcb_get_keyboard_mapping_reply_t* keymap; // Keyboard mapping, NULL until it has arrived
+	InputKeyMap			key_codes;			// Keysyms of the keyboard mapping to key codes
+	InputXcbRequest		keymap_request;		// xcb_get_keyboard_mapping
+	InputXcbRequest		keys_request;		// xcb_query_keymap
+	InputXcbRequest		root_request;		// xcb_get_geometry
+} InputXcb;
+
+#define input_xcb() ( (InputXcb*)input_context_state()->platform )
+
+// --------------------------------------------------
+
+static uint32 input_get_modifier( xcb_keysym_t sym )
+{
+	switch ( sym )
+	{
+	case XK_Shift_L: return INPUT_MOD_LSHIFT;
+	case XK_Shift_R: return INPUT_MOD_RSHIFT;
+	case XK_Control_L: return INPUT_MOD_LCONTROL;
+	case XK_Control_R: return INPUT_MOD_RCONTROL;
+	case XK_Alt_L: case XK_Meta_L: return INPUT_MOD_LALT;
+	case XK_Alt_R: case XK_Meta_R: case XK_ISO_Level3_Shift: return INPUT_MOD_RALT;
+	case XK_Super_L: return INPUT_MOD_LSUPER;
+	case XK_Super_R: return INPUT_MOD_RSUPER;
+	}
+
+	return 0;
+}
+
+static void input_update_locks( uint16 state, xcb_keysym_t sym, bool press )
+{
+	uint32 locks;
+
+	// The state of the event is the state before the key was pressed
+	locks = input_get_modifiers() & INPUT_MOD_SCROLLLOCK;
+	if ( state & XCB_MOD_MASK_LOCK ) locks |= INPUT_MOD_CAPSLOCK;
+	if ( state & XCB_MOD_MASK_2 ) locks |= INPUT_MOD_NUMLOCK;
+
+	if ( press )
+	{
+		switch ( sym )
+		{
+		case XK_Caps_Lock: locks ^= INPUT_MOD_CAPSLOCK; break;
+		case XK_Num_Lock: locks ^= INPUT_MOD_NUMLOCK; break;
+		case XK_Scroll_Lock: locks ^= INPUT_MOD_SCROLLLOCK; break;
+		}
+	}
+
+	input_set_lock_state( locks );
+}
+
+static xcb_keysym_t input_get_keysym( InputXcb* xcb, xcb_keycode_t keycode, uint32 level )
+{
+	uint32 per, index;
+
+	if ( xcb->keymap == NULL || keycode < xcb->min_keycode ) return XCB_NO_SYMBOL;
+
+	per = xcb->keymap->keysyms_per_keycode;
+	if ( level >= per ) return XCB_NO_SYMBOL;
+
+	index = ( keycode - xcb->min_keycode ) * per + level;
+	if ( index >= (uint32)xcb_get_keyboard_mapping_keysyms_length( xcb->keymap ) ) return XCB_NO_SYMBOL;
+
+	return xcb_get_keyboard_mapping_keysyms( xcb->keymap )[index];
+}
+
+static xcb_keysym_t input_lookup_keysym( InputXcb* xcb, xcb_keycode_t keycode, uint16 state )
+{
+	xcb_keysym_t lower, upper;
+	bool shift;
+
+	// Picks the symbol of the key like XLookupString does with the core keyboard rules
+	lower = input_get_keysym( xcb, keycode, 0 );
+	upper = input_get_keysym( xcb, keycode, 1 );
+
+	if ( upper == XCB_NO_SYMBOL )
+	{
+		upper = lower;
+		if ( lower >= XK_a && lower <= XK_z ) upper = lower - ( XK_a - XK_A );
+	}
+
+	shift = ( state & XCB_MOD_MASK_SHIFT ) != 0;
+
+	// Num lock inverts shift on the keypad, caps lock on letters
+	if ( upper >= XK_KP_Space && upper <= XK_KP_Equal )
+	{
+		if ( state & XCB_MOD_MASK_2 ) shift = !shift;
+	}
+	else if ( ( state & XCB_MOD_MASK_LOCK ) && lower >= XK_a && lower <= XK_z )
+	{
+		shift = !shift;
+	}
+
+	return shift ? upper : lower;
+}
+
+static uint32 input_get_keysym_char( xcb_keysym_t sym, uint16 state )
+{
+	// Latin-1 keysyms are the characters themselves
+	if ( ( sym >= 0x20 && sym <= 0x7E ) || ( sym >= 0xA0 && sym <= 0xFF ) )
+	{
+		if ( ( state & XCB_MOD_MASK_CONTROL ) && sym >= '@' && sym <= '~' ) return sym & 0x1F;
+		return sym;
+	}
+
+	// Unicode keysyms
+	if ( sym >= 0x1000100 && sym <= 0x110FFFF ) return sym - 0x1000000;
+
+	switch ( sym )
+	{
+	case XK_BackSpace: case XK_Tab: case XK_Return: case XK_Escape: case XK_Delete:
+		return sym & 0x7F;
+
+	case XK_KP_Space: return ' ';
+	case XK_KP_Tab: return '\t';
+	case XK_KP_Enter: return '\r';
+	case XK_KP_Equal: return '=';
+	}
+
+	// From * to 9 the keypad keysyms follow the order of ASCII
+	if ( sym >= XK_KP_Multiply && sym <= XK_KP_9 ) return sym - XK_KP_Multiply + '*';
+
+	return 0;
+}
+
+static void input_request_keymap( InputXcb* xcb )
+{
+	const xcb_setup_t* setup;
+
+	setup = xcb_get_setup( xcb->connection );
+
+	xcb->keymap_request.sequence = xcb_get_keyboard_mapping( xcb->connection, setup->min_keycode,
+								   setup->max_keycode - setup->min_keycode + 1 ).sequence;
+	xcb->keymap_request.pending = true;
+}
+
+static bool input_poll_reply( InputXcb* xcb, InputXcbRequest* request, void** reply )
+{
+	xcb_generic_error_t* error = NULL;
+
+	*reply = NULL;
+
+	if ( !request->pending ) return false;
+	if ( !xcb_poll_for_reply( xcb->connection, request->sequence, reply, &error ) ) return false;
+
+	// The request is done even if it failed, in which case the reply is NULL
+	request->pending = false;
+	free( error );
+
+	return true;
+}
+
+static void input_build_key_codes( InputXcb* xcb )
+{
+	const xcb_keysym_t* syms;
+	int i, count, per;
+
+	input_keymap_destroy( &xcb->key_codes );
+
+	per = xcb->keymap->keysyms_per_keycode;
+	if ( per == 0 ) return;
+
+	syms = xcb_get_keyboard_mapping_keysyms( xcb->keymap );
+	count = xcb_get_keyboard_mapping_keysyms_length( xcb->keymap );
+
+	if ( !input_keymap_create( &xcb->key_codes, (uint32)count ) ) return;
+
+	// The lowest key code producing a keysym on any level wins
+	for ( i = 0; i < count; i++ )
+		input_keymap_add( &xcb->key_codes, syms[i], xcb->min_keycode + (uint32)( i / per ) );
+}
+
+static void input_poll_replies( InputXcb* xcb )
+{
+	xcb_get_keyboard_mapping_reply_t* keymap;
+	xcb_query_keymap_reply_t* keys;
+	xcb_get_geometry_reply_t* geometry;
+
+	if ( input_poll_reply( xcb, &xcb->keymap_request, (void**)&keymap ) && keymap != NULL )
+	{
+		free( xcb->keymap );
+		xcb->keymap = keymap;
+		xcb->min_keycode = xcb_get_setup( xcb->connection )->min_keycode;
+
+		input_build_key_codes( xcb );
+	}
+
+	if ( input_poll_reply( xcb, &xcb->keys_request, (void**)&keys ) && keys != NULL )
+	{
+		input_set_key_states( keys->keys );
+		free( keys );
+	}
+
+	if ( input_poll_reply( xcb, &xcb->root_request, (void**)&geometry ) && geometry != NULL )
+	{
+		xcb->root = geometry->root;
+		free( geometry );
+	}
+}
+
+static void input_discard_request( InputXcb* xcb, InputXcbRequest* request )
+{
+	if ( request->pending ) xcb_discard_reply( xcb->connection, request->sequence );
+	request->pending = false;
+}
+
+void input_platform_initialize( void* wnd )
+{
+	InputXcbWindow* window = (InputXcbWindow*)wnd;
+	InputXcb* xcb;
+
+	if ( window == NULL || window->connection == NULL ) return;
+
+	xcb = mem_alloc_clean( sizeof(*xcb) );
+	if ( xcb == NULL ) return;
+
+	xcb->connection = (xcb_connection_t*)window->connection;
+	xcb->window = (xcb_window_t)window->window;
+	xcb->event_func = window->event_func;
+	xcb->event_data = window->event_data;
+	input_clock_reset( &xcb->server_clock );
+
+	// Use the first screen until the server tells which one the window is on
+	xcb->root = xcb_setup_roots_iterator( xcb_get_setup( xcb->connection ) ).data->root;
+
+	xcb->root_request.sequence = xcb_get_geometry( xcb->connection, xcb->window ).sequence;
+	xcb->root_request.pending = true;
+
+	input_request_keymap( xcb );
+	xcb_flush( xcb->connection );
+
+	input_context_state()->platform = xcb;
+}
+
+void input_platform_shutdown( void )
+{
+	InputContextState* state = input_context_state();
+	InputXcb* xcb = (InputXcb*)state->platform;
+
+	if ( xcb != NULL )
+	{
+		input_discard_request( xcb, &xcb->keymap_request );
+		input_discard_request( xcb, &xcb->keys_request );
+		input_discard_request( xcb, &xcb->root_request );
+
+		free( xcb->keymap );
+		input_keymap_destroy( &xcb->key_codes );
+		mem_free( xcb );
+	}
+
+	state->platform = NULL;
+}
+
+uint64 input_platform_get_time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64)ts.tv_sec * 1000000000 + (uint64)ts.tv_nsec;
+}
+
+static void input_update_event_time( InputXcb* xcb, xcb_timestamp_t time )
+{
+	input_set_event_time( input_clock_convert( &xcb->server_clock, (uint32)time, input_platform_get_time() ) );
+}
+
+void input_enable_hook( bool enable )
+{
+	// We actually don't have a working hook for X window system... yet.
+	UNREFERENCED_PARAM( enable );
+}
+
+static bool input_process_button( InputXcb* xcb, xcb_button_press_event_t* button, bool press )
+{
+	xcb_grab_pointer_cookie_t cookie;
+	int16 x, y;
+
+	x = (int16)button->event_x;
+	y = (int16)button->event_y;
+
+	switch ( button->detail )
+	{
+	case XCB_BUTTON_INDEX_1:
+		// Left mouse button
+		if ( press )
+		{
+			cookie = xcb_grab_pointer( xcb->connection, 0, xcb->window, XCB_EVENT_MASK_BUTTON_PRESS|XCB_EVENT_MASK_BUTTON_RELEASE|
+									   XCB_EVENT_MASK_POINTER_MOTION|XCB_EVENT_MASK_ENTER_WINDOW|XCB_EVENT_MASK_LEAVE_WINDOW,
+									   XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, xcb->window, XCB_NONE, XCB_CURRENT_TIME );
+
+			// Nothing is done differently if the grab fails, so don't wait for the status
+			xcb_discard_reply( xcb->connection, cookie.sequence );
+
+			return input_post_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
+		}
+
+		xcb_ungrab_pointer( xcb->connection, XCB_CURRENT_TIME );
+		return input_post_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
+
+	case XCB_BUTTON_INDEX_3:
+		// Right mouse button
+		return input_post_mouse_event( press ? INPUT_RBUTTON_DOWN : INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
+
+	case XCB_BUTTON_INDEX_2:
+		// Middle mouse button (wheel)
+		return input_post_mouse_event( press ? INPUT_MBUTTON_DOWN : INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
+
+	case XCB_BUTTON_INDEX_4:
+		// Mouse wheel scroll up
+		if ( press ) return input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_UP );
+		break;
+
+	case XCB_BUTTON_INDEX_5:
+		// Mouse wheel scroll down
+		if ( press ) return input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_DOWN );
+		break;
+	}
+
+	return true;
+}
+
+static bool input_process_event( InputXcb* xcb, xcb_generic_event_t* event )
+{
+	xcb_key_press_event_t* key;
+	xcb_button_press_event_t* button;
+	xcb_motion_notify_event_t* motion;
+	xcb_keymap_notify_event_t* keymap;
+	xcb_mapping_notify_event_t* mapping;
+	xcb_focus_in_event_t* focus;
+	xcb_keysym_t sym;
+	uint8 keys[32];
+	uint32 code;
+
+	switch ( event->response_type & ~0x80 )
+	{
+	case XCB_KEY_PRESS:
+		{
+			key = (xcb_key_press_event_t*)event;
+			if ( key->event != xcb->window ) return true;
+
+			input_update_event_time( xcb, key->time );
+
+			sym = input_lookup_keysym( xcb, key->detail, key->state );
+			code = (uint32)sym;
+
+			input_set_modifiers( input_get_modifier( sym ), true );
+			input_update_locks( key->state, sym, true );
+			input_set_key_state( key->detail, true );
+
+			if ( sym == XCB_NO_SYMBOL ) return true;
+
+			// A dodgy fix to make windows and linux hooks/binds compatible:
+			// Convert lowercase characters to upper case before processing hooks.
+			if ( code >= 'a' && code <= 'z' ) code -= ( 'a' - 'A' );
+
+			if ( !input_post_key_event( INPUT_KEY_DOWN, code ) ) return false;
+
+			code = input_get_keysym_char( sym, key->state );
+			if ( code == 0 ) return true;
+
+			return input_post_key_event( INPUT_CHARACTER, code );
+		}
+
+	case XCB_KEY_RELEASE:
+		{
+			key = (xcb_key_release_event_t*)event;
+			if ( key->event != xcb->window ) return true;
+
+			input_update_event_time( xcb, key->time );
+
+			sym = input_get_keysym( xcb, key->detail, 0 );
+
+			input_set_modifiers( input_get_modifier( sym ), false );
+			input_update_locks( key->state, sym, false );
+			input_set_key_state( key->detail, false );
+
+			if ( sym == XCB_NO_SYMBOL ) return true;
+
+			return input_post_key_event( INPUT_KEY_UP, (uint32)sym );
+		}
+
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+		{
+			button = (xcb_button_press_event_t*)event;
+			if ( button->event != xcb->window ) return true;
+
+			input_update_event_time( xcb, button->time );
+
+			return input_process_button( xcb, button, ( event->response_type & ~0x80 ) == XCB_BUTTON_PRESS );
+		}
+
+	case XCB_MOTION_NOTIFY:
+		{
+			motion = (xcb_motion_notify_event_t*)event;
+			if ( motion->event != xcb->window ) return true;
+
+			input_update_event_time( xcb, motion->time );
+
+			return input_post_mouse_event( INPUT_MOUSE_MOVE, (int16)motion->event_x, (int16)motion->event_y,
+										   MOUSE_NONE, MWHEEL_STATIONARY );
+		}
+
+	case XCB_FOCUS_IN:
+		{
+			focus = (xcb_focus_in_event_t*)event;
+			if ( focus->event != xcb->window ) return true;
+
+			// Keys may have been pressed or released while another window had the focus.
+			// The key bitmap is updated when the reply arrives.
+			input_discard_request( xcb, &xcb->keys_request );
+
+			xcb->keys_request.sequence = xcb_query_keymap( xcb->connection ).sequence;
+			xcb->keys_request.pending = true;
+
+			return true;
+		}
+
+	case XCB_FOCUS_OUT:
+		{
+			focus = (xcb_focus_out_event_t*)event;
+			if ( focus->event != xcb->window ) return true;
+
+			// Releases are not delivered to unfocused windows, drop the held keys
+			input_set_modifiers( ~INPUT_MOD_LOCKS, false );
+			input_set_key_states( NULL );
+			return true;
+		}
+
+	case XCB_KEYMAP_NOTIFY:
+		{
+			// The event leaves out the first byte, key codes 0-7 are never used
+			keymap = (xcb_keymap_notify_event_t*)event;
+
+			keys[0] = 0;
+			memcpy( &keys[1], keymap->keys, sizeof(keymap->keys) );
+
+			input_set_key_states( keys );
+			return true;
+		}
+
+	case XCB_MAPPING_NOTIFY:
+		{
+			// Keep using the old mapping until the new one has arrived
+			mapping = (xcb_mapping_notify_event_t*)event;
+
+			if ( mapping->request == XCB_MAPPING_KEYBOARD )
+			{
+				input_discard_request( xcb, &xcb->keymap_request );
+				input_request_keymap( xcb );
+			}
+
+			return true;
+		}
+	}
+
+	return true;
+}
+
+static void input_pump_events( InputXcb* xcb )
+{
+	xcb_generic_event_t* event;
+	bool unconsumed;
+
+	// Only the first poll reads from the connection, the rest of the batch is what
+	// that read brought in. A steady stream of events can't keep the pump going.
+	event = xcb_poll_for_event( xcb->connection );
+	input_poll_replies( xcb );
+
+	while ( event != NULL )
+	{
+		unconsumed = input_process_event( xcb, event );
+
+		if ( unconsumed && xcb->event_func != NULL )
+			xcb->event_func( event, xcb->event_data );
+
+		free( event );
+
+		// The context may have been shut down by a handler
+		if ( input_xcb() != xcb ) return;
+
+		event = xcb_poll_for_queued_event( xcb->connection );
+	}
+}
+
+bool input_process( void* data )
+{
+	InputXcb* xcb = input_xcb();
+	bool ret = true;
+
+	if ( xcb == NULL ) return true;
+
+	input_poll_replies( xcb );
+
+	if ( data != NULL ) ret = input_process_event( xcb, (xcb_generic_event_t*)data );
+	else input_pump_events( xcb );
+
+	// Send the requests made while processing, the context may be gone after pumping
+	if ( input_xcb() == xcb ) xcb_flush( xcb->connection );
+
+	return ret;
+}
+
+uint32 input_platform_get_key_code( uint32 key )
+{
+	InputXcb* xcb = input_xcb();
+
+	// The keyboard mapping is kept locally, this does not talk to the server
+	if ( xcb == NULL ) return INPUT_KEY_CODE_NONE;
+
+	return input_keymap_find( &xcb->key_codes, key );
+}
+
+static void input_hide_mouse_cursor( InputXcb* xcb )
+{
+	xcb_pixmap_t pixmap;
+	xcb_gcontext_t gc;
+	xcb_cursor_t cursor;
+	xcb_rectangle_t rect = { 0, 0, 1, 1 };
+	uint32 value = 0;
+
+	// The cursor is a single pixel masked out by a cleared bitmap
+	pixmap = xcb_generate_id( xcb->connection );
+	xcb_create_pixmap( xcb->connection, 1, pixmap, xcb->window, 1, 1 );
+
+	gc = xcb_generate_id( xcb->connection );
+	xcb_create_gc( xcb->connection, gc, pixmap, XCB_GC_FOREGROUND, &value );
+	xcb_poly_fill_rectangle( xcb->connection, pixmap, gc, 1, &rect );
+	xcb_free_gc( xcb->connection, gc );
+
+	cursor = xcb_generate_id( xcb->connection );
+	xcb_create_cursor( xcb->connection, cursor, pixmap, pixmap, 0, 0, 0, 0, 0, 0, 0, 0 );
+
+	xcb_change_window_attributes( xcb->connection, xcb->window, XCB_CW_CURSOR, &cursor );
+
+	xcb_free_cursor( xcb->connection, cursor );
+	xcb_free_pixmap( xcb->connection, pixmap );
+}
+
+static void input_define_default_cursor( InputXcb* xcb )
+{
+	uint32 cursor = XCB_CURSOR_NONE;
+
+	xcb_change_window_attributes( xcb->connection, xcb->window, XCB_CW_CURSOR, &cursor );
+}
+
+void input_show_mouse_cursor( bool show )
+{
+	InputXcb* xcb = input_xcb();
+
+	input_context_state()->show_cursor = show;
+
+	if ( xcb == NULL ) return;
+
+	if ( show )
+	{
+		input_define_default_cursor( xcb );
+	}
+	else
+	{
+		input_hide_mouse_cursor( xcb );
+	}
+
+	xcb_flush( xcb->connection );
+}
+
+void input_show_mouse_cursor_ref( bool show )
+{
+	InputContextState* state = input_context_state();
+	InputXcb* xcb = input_xcb();
+
+	if ( xcb == NULL ) return;
+
+	if ( !show )
+	{
+		if ( state->cursor_refs )
+		{
+			if ( --state->cursor_refs == 0 )
+			{
+				input_hide_mouse_cursor( xcb );
+				state->show_cursor = false;
+			}
+		}
+	}
+	else
+	{
+		if ( state->cursor_refs++ == 0 )
+		{
+			input_define_default_cursor( xcb );
+			state->show_cursor = true;
+		}
+	}
+
+	xcb_flush( xcb->connection );
+}
+
+void input_set_cursor_pos( int16 x, int16 y )
+{
+	InputContextState* state = input_context_state();
+	InputXcb* xcb = input_xcb();
+
+	state->mouse_x = x;
+	state->mouse_y = y;
+
+	if ( xcb == NULL ) return;
+
+	xcb_warp_pointer( xcb->connection, XCB_NONE, xcb->root, 0, 0, 0, 0, x, y );
+	xcb_flush( xcb->connection );
+}
+
+bool input_platform_set_relative_mouse( bool enable )
+{
+	// Raw motion needs the XInput extension, which this backend doesn't use
+	UNREFERENCED_PARAM( enable );
+	return false;
+}
+
+#endif /* !_WIN32 && !INPUT_HEADLESS && INPUT_XCB */
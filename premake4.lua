@@ -1,13 +1,50 @@
 -- Input hook library
 
+newoption {
+	trigger = "headless",
+	description = "Build Lib-Input with the headless backend instead of the window system"
+}
+
+newoption {
+	trigger = "xcb",
+	description = "Build Lib-Input with the XCB backend instead of Xlib on X11"
+}
+
+newoption {
+	trigger = "evdev",
+	description = "Build Lib-Input reading Linux event devices directly instead of the window system"
+}
+
+newoption {
+	trigger = "profile",
+	description = "Build Lib-Input with per handler profiling"
+}
+
 project "Lib-Input"
 	kind "StaticLib"
 	language "C"
 	files { "**.h", "**.c", "premake4.lua" }
+	excludes { "Bench/**" }
 	vpaths { [""] = { "../Libraries/Input" } }
 	includedirs { ".", ".." }
 	location ( "../../Projects/" .. os.get() .. "/" .. _ACTION )
 	
+	if _OPTIONS["headless"] then
+		defines { "INPUT_HEADLESS" }
+	end
+	
+	if _OPTIONS["xcb"] then
+		defines { "INPUT_XCB" }
+	end
+	
+	if _OPTIONS["evdev"] then
+		defines { "INPUT_EVDEV" }
+	end
+	
+	if _OPTIONS["profile"] then
+		defines { "INPUT_PROFILE" }
+	end
+	
 	-- Linux specific stuff
 	configuration "linux"
 		targetextension ".a"
@@ -21,3 +58,38 @@ project "Lib-Input"
 		buildoptions { "/wd4201 /wd4206" } -- C4201: nameless struct/union, C4206: translation unit is empty
 		configuration "Debug" targetname "inputd"
 		configuration "Release" targetname "input"
+
+-- Mouse bind hit test micro-benchmark
+
+project "Lib-Input-Bench"
+	kind "ConsoleApp"
+	language "C"
+	files { "Bench/BenchHitTest.c" }
+	includedirs { ".", ".." }
+	links { "Lib-Input" }
+	location ( "../../Projects/" .. os.get() .. "/" .. _ACTION )
+	
+	configuration "linux"
+		buildoptions { "-fms-extensions" }
+		links { "rt" }
+	
+	configuration "windows"
+		buildoptions { "/wd4201" }
+
+-- Dispatch benchmark, builds the library with the headless backend so events can be
+-- injected without a window. Writes the results to stdout as JSON.
+
+project "Lib-Input-Dispatch-Bench"
+	kind "ConsoleApp"
+	language "C"
+	files { "*.c", "Bench/BenchDispatch.c" }
+	includedirs { ".", ".." }
+	defines { "INPUT_HEADLESS" }
+	location ( "../../Projects/" .. os.get() .. "/" .. _ACTION )
+	
+	configuration "linux"
+		buildoptions { "-fms-extensions" }
+		links { "rt" }
+	
+	configuration "windows"
+		buildoptions { "/wd4201 /wd4206" }